@@ -0,0 +1,259 @@
+#include "bench-utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+
+namespace {
+
+std::size_t allocations = 0;
+std::size_t live_bytes = 0;
+
+// Every block is prefixed with its size so that unsized deletes can keep `live_bytes` exact.
+constexpr std::size_t header_size = alignof(std::max_align_t);
+
+void* counted_allocate(std::size_t size) {
+  void* block = std::malloc(size + header_size);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  ++allocations;
+  live_bytes += size;
+  *static_cast<std::size_t*>(block) = size;
+  return static_cast<std::byte*>(block) + header_size;
+}
+
+void counted_deallocate(void* ptr) noexcept {
+  if (ptr == nullptr) {
+    return;
+  }
+  void* block = static_cast<std::byte*>(ptr) - header_size;
+  live_bytes -= *static_cast<std::size_t*>(block);
+  std::free(block);
+}
+
+// Over-aligned blocks get a prefix as wide as their alignment, which keeps the result aligned.
+std::size_t aligned_header_size(std::align_val_t alignment) noexcept {
+  return std::max(static_cast<std::size_t>(alignment), header_size);
+}
+
+void* counted_allocate(std::size_t size, std::align_val_t alignment) {
+  std::size_t prefix = aligned_header_size(alignment);
+  void* block = std::aligned_alloc(prefix, (size + 2 * prefix - 1) / prefix * prefix);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  ++allocations;
+  live_bytes += size;
+  *static_cast<std::size_t*>(block) = size;
+  return static_cast<std::byte*>(block) + prefix;
+}
+
+void counted_deallocate(void* ptr, std::align_val_t alignment) noexcept {
+  if (ptr == nullptr) {
+    return;
+  }
+  void* block = static_cast<std::byte*>(ptr) - aligned_header_size(alignment);
+  live_bytes -= *static_cast<std::size_t*>(block);
+  std::free(block);
+}
+
+// Single passes are collected here and printed after Catch's own report, which they would otherwise interleave.
+struct Summary {
+  Summary() = default;
+
+  Summary(const Summary&) = delete;
+  Summary& operator=(const Summary&) = delete;
+
+  ~Summary() {
+    if (rows.empty()) {
+      return;
+    }
+    std::printf(
+        "\n%-24s %-14s %12s %12s %12s %14s %10s %10s %10s %10s", "workload", "container", "n", "ns/op",
+        "allocs/op", "bytes/element", "p50", "p99", "p99.9", "max"
+    );
+    if (ct_bench::PerfCounters::requested()) {
+      for (std::size_t i = 0; i < ct_bench::perf_event_count; ++i) {
+        std::string name = std::string(ct_bench::to_string(static_cast<ct_bench::PerfEvent>(i))) + "/op";
+        std::printf(" %12s", name.c_str());
+      }
+    }
+    std::printf("\n");
+    for (const std::string& row : rows) {
+      std::printf("%s\n", row.c_str());
+    }
+  }
+
+  std::vector<std::string> rows;
+};
+
+Summary& summary() {
+  static Summary instance;
+  return instance;
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+  return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+  return counted_allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  counted_deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  counted_deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+  counted_deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+  counted_deallocate(ptr);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return counted_allocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+  return counted_allocate(size, alignment);
+}
+
+void operator delete(void* ptr, std::align_val_t alignment) noexcept {
+  counted_deallocate(ptr, alignment);
+}
+
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept {
+  counted_deallocate(ptr, alignment);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t alignment) noexcept {
+  counted_deallocate(ptr, alignment);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t alignment) noexcept {
+  counted_deallocate(ptr, alignment);
+}
+
+namespace ct_bench {
+
+std::size_t allocation_count() noexcept {
+  return allocations;
+}
+
+std::size_t allocated_bytes() noexcept {
+  return live_bytes;
+}
+
+std::vector<std::size_t> bench_sizes() {
+  std::size_t max_size = 1'000'000;
+  if (const char* env = std::getenv("CT_BENCH_MAX_SIZE")) {
+    max_size = std::min<std::size_t>(std::stoull(env), 100'000'000);
+  }
+  std::vector<std::size_t> result;
+  for (std::size_t n = 1'000; n <= max_size; n *= 10) {
+    result.push_back(n);
+  }
+  return result;
+}
+
+std::vector<int> ascending_keys(std::size_t n) {
+  std::vector<int> result(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    result[i] = static_cast<int>(2 * i);
+  }
+  return result;
+}
+
+std::vector<int> random_keys(std::size_t n, std::uint64_t seed) {
+  std::vector<int> result = ascending_keys(n);
+  std::shuffle(result.begin(), result.end(), std::mt19937_64(seed));
+  return result;
+}
+
+std::vector<int> zipfian_keys(std::size_t n, std::uint64_t seed) {
+  // Inverts the continuous 1/x density over [1, n + 1): rank = (n + 1)^u. Close to Zipf with s = 1 and needs no
+  // O(n) table, which matters at 1e8.
+  std::mt19937_64 gen(seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  double log_range = std::log(static_cast<double>(n) + 1);
+  std::vector<int> result(n);
+  for (int& key : result) {
+    auto rank = static_cast<std::size_t>(std::exp(unit(gen) * log_range)) - 1;
+    key = static_cast<int>(2 * std::min(rank, n - 1));
+  }
+  return result;
+}
+
+PassReport::PassReport(
+    std::string_view workload,
+    std::string_view container,
+    std::size_t size,
+    std::size_t ops
+) noexcept
+    : workload(workload)
+    , container(container)
+    , size(size)
+    , ops(ops)
+    , allocations_before(allocations) {
+  if (PerfCounters::requested()) {
+    counters.emplace();
+    counters->start();
+  }
+  start = std::chrono::steady_clock::now();
+}
+
+PassReport::~PassReport() {
+  auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  PerfCounts counts;
+  if (counters) {
+    counts = counters->stop();
+  }
+  auto ops_count = static_cast<double>(std::max<std::size_t>(ops, 1));
+  std::array<char, 320> line;
+  int length = std::snprintf(
+      line.data(), line.size(), "%-24.*s %-14.*s %12zu %12.1f %12.3f %14.1f", static_cast<int>(workload.size()),
+      workload.data(), static_cast<int>(container.size()), container.data(), size, elapsed / ops_count,
+      static_cast<double>(allocations - allocations_before) / ops_count, bytes_per_element
+  );
+  if (latencies) {
+    length += std::snprintf(
+        line.data() + length, line.size() - static_cast<std::size_t>(length), " %10llu %10llu %10llu %10llu",
+        static_cast<unsigned long long>(latencies->percentile(0.5)),
+        static_cast<unsigned long long>(latencies->percentile(0.99)),
+        static_cast<unsigned long long>(latencies->percentile(0.999)),
+        static_cast<unsigned long long>(latencies->max())
+    );
+  } else if (counters) {
+    length += std::snprintf(
+        line.data() + length, line.size() - static_cast<std::size_t>(length), " %10s %10s %10s %10s", "", "", "", ""
+    );
+  }
+  if (counters) {
+    for (const auto& count : counts) {
+      std::size_t room = line.size() - static_cast<std::size_t>(length);
+      if (count) {
+        length += std::snprintf(line.data() + length, room, " %12.3f", static_cast<double>(*count) / ops_count);
+      } else {
+        length += std::snprintf(line.data() + length, room, " %12s", "n/a");
+      }
+    }
+  }
+  summary().rows.emplace_back(line.data());
+}
+
+} // namespace ct_bench
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "latency-histogram.h"
+#include "perf-counters.h"
+#include "treap.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace ct_bench {
+
+// Every global `operator new` of the bench binary goes through a counter.
+std::size_t allocation_count() noexcept;
+std::size_t allocated_bytes() noexcept;
+
+// Sizes to run every workload at: powers of ten from 1e3 up to `CT_BENCH_MAX_SIZE` (1e6 unless set, at most 1e8).
+std::vector<std::size_t> bench_sizes();
+
+// Even keys `0, 2, ..., 2 (n - 1)`, so odd keys are guaranteed misses.
+std::vector<int> ascending_keys(std::size_t n);
+std::vector<int> random_keys(std::size_t n, std::uint64_t seed);
+// `n` draws from `ascending_keys(n)` with a Zipf-like skew: the key of rank `r` has probability about 1 / r.
+std::vector<int> zipfian_keys(std::size_t n, std::uint64_t seed);
+
+using HotColdTreap = ct::Treap<int, std::mt19937, ct::NoAugmentation, ct::NoInstrumentation, ct::HotColdLayout>;
+using BloomTreap = ct::Treap<
+    int,
+    std::mt19937,
+    ct::NoAugmentation,
+    ct::NoInstrumentation,
+    ct::PlainLayout,
+    ct::NoKeyPrefix,
+    ct::BloomFilter>;
+using PrefixedStringTreap = ct::Treap<
+    std::string,
+    std::mt19937,
+    ct::NoAugmentation,
+    ct::NoInstrumentation,
+    ct::PlainLayout,
+    ct::StringKeyPrefix<>>;
+
+template <typename C>
+constexpr std::string_view container_name() noexcept {
+  if constexpr (std::is_same_v<C, std::set<int>> || std::is_same_v<C, std::set<std::string>>) {
+    return "std::set";
+  } else if constexpr (std::is_same_v<C, HotColdTreap>) {
+    return "ct::Treap h/c";
+  } else if constexpr (std::is_same_v<C, BloomTreap>) {
+    return "ct::Treap bloom";
+  } else if constexpr (std::is_same_v<C, PrefixedStringTreap>) {
+    return "ct::Treap pfx";
+  } else {
+    return "ct::Treap";
+  }
+}
+
+// Times one pass of a workload outside of Catch's sampling. Its ns/op, allocations/op, bytes/element and latency
+// percentiles go to a summary table printed when the program exits. With `CT_BENCH_PERF` set, the pass also counts
+// cache, TLB and branch misses per operation, shown as `n/a` where the hardware counters are unavailable.
+class PassReport {
+public:
+  PassReport(std::string_view workload, std::string_view container, std::size_t size, std::size_t ops) noexcept;
+
+  PassReport(const PassReport&) = delete;
+  PassReport& operator=(const PassReport&) = delete;
+
+  ~PassReport();
+
+  // Live heap bytes per element of the container at the end of the pass, if it is meaningful for the workload.
+  void set_bytes_per_element(double bytes) noexcept {
+    bytes_per_element = bytes;
+  }
+
+  // Per-operation latencies in nanoseconds, recorded in a separate pass so that reading the clock does not slow
+  // down the timed one.
+  void set_latencies(const ct::LatencyHistogram& histogram) noexcept {
+    latencies = histogram;
+  }
+
+private:
+  std::string_view workload;
+  std::string_view container;
+  std::size_t size;
+  std::size_t ops;
+  std::size_t allocations_before;
+  double bytes_per_element = 0;
+  std::optional<ct::LatencyHistogram> latencies;
+  std::optional<PerfCounters> counters;
+  std::chrono::steady_clock::time_point start;
+};
+
+} // namespace ct_bench
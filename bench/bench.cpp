@@ -0,0 +1,234 @@
+#include "bench-utils.h"
+#include "latency-histogram.h"
+#include "treap.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ct_bench {
+
+namespace {
+
+template <typename C, typename K>
+C build(const std::vector<K>& keys) {
+  C c;
+  for (const K& key : keys) {
+    c.insert(key);
+  }
+  return c;
+}
+
+template <typename C, typename K>
+void bench_insert(std::string_view workload, const std::vector<K>& keys) {
+  std::size_t n = keys.size();
+  {
+    std::size_t bytes_before = allocated_bytes();
+    PassReport report(workload, container_name<C>(), n, n);
+    C c = build<C>(keys);
+    report.set_bytes_per_element(static_cast<double>(allocated_bytes() - bytes_before) / static_cast<double>(c.size()));
+  }
+  BENCHMARK(std::string(workload) + " n=" + std::to_string(n)) {
+    return build<C>(keys);
+  };
+}
+
+// Measures one operation at a time; `op(i)` performs the `i`-th one.
+template <typename C, typename Op>
+void bench_per_op(std::string_view workload, std::size_t n, Op op) {
+  std::size_t checksum = 0;
+  ct::LatencyHistogram latencies;
+  for (std::size_t i = 0; i < n; ++i) {
+    std::uint64_t start = ct::SteadyClockSource::now();
+    checksum += static_cast<std::size_t>(op(i));
+    latencies.record(ct::SteadyClockSource::now() - start);
+  }
+  {
+    PassReport report(workload, container_name<C>(), n, n);
+    report.set_latencies(latencies);
+    for (std::size_t i = 0; i < n; ++i) {
+      checksum += static_cast<std::size_t>(op(i));
+    }
+  }
+  // Keeps the pass above from being optimized out.
+  REQUIRE(checksum != static_cast<std::size_t>(-1));
+  BENCHMARK_ADVANCED(std::string(workload) + " n=" + std::to_string(n))(Catch::Benchmark::Chronometer meter) {
+    meter.measure([&op, n](int i) { return op(static_cast<std::size_t>(i) % n); });
+  };
+}
+
+// Keys long enough to live on the heap. With `shared_start` they share a long prefix, as namespaced identifiers do,
+// so every comparison has to read past it; otherwise what tells them apart comes first.
+std::vector<std::string> string_keys(const std::vector<int>& keys, bool shared_start) {
+  std::vector<std::string> result;
+  result.reserve(keys.size());
+  for (int key : keys) {
+    std::string digits = std::to_string(key);
+    if (shared_start) {
+      result.push_back("tenant/default/object/" + std::string(10 - digits.size(), '0') + digits);
+    } else {
+      result.push_back(digits + "/tenant/default/object");
+    }
+  }
+  return result;
+}
+
+// Every write toggles an odd key, so the size stays close to `n` and half of the writes insert.
+template <typename C>
+void bench_mixed(std::string_view workload, C& c, const std::vector<int>& keys, std::size_t writes_per_10) {
+  bench_per_op<C>(workload, keys.size(), [&c, &keys, writes_per_10](std::size_t i) {
+    int key = keys[i];
+    if (i % 10 < writes_per_10) {
+      if (!c.insert(key + 1).second) {
+        c.erase(key + 1);
+      }
+      return true;
+    }
+    return c.find(key) != c.end();
+  });
+}
+
+} // namespace
+
+TEMPLATE_TEST_CASE("Workloads", "[bench]", ct::Treap<int>, HotColdTreap, BloomTreap, std::set<int>) {
+  using C = TestType;
+  constexpr std::string_view name = container_name<C>();
+
+  std::size_t n = GENERATE(Catch::Generators::from_range(bench_sizes()));
+  std::vector<int> random = random_keys(n, 1345);
+
+  bench_insert<C>("insert random", random);
+  bench_insert<C>("insert ascending", ascending_keys(n));
+  bench_insert<C>("insert zipfian", zipfian_keys(n, 1346));
+
+  C c = build<C>(random);
+  std::vector<int> lookups = random_keys(n, 1347);
+
+  bench_per_op<C>("find hit", n, [&](std::size_t i) { return c.find(lookups[i]) != c.end(); });
+  bench_per_op<C>("find miss", n, [&](std::size_t i) { return c.find(lookups[i] + 1) != c.end(); });
+  bench_per_op<C>("lower_bound", n, [&](std::size_t i) { return c.lower_bound(lookups[i] + 1) != c.end(); });
+
+  {
+    PassReport report("iteration", name, n, n);
+    long long sum = 0;
+    for (int value : c) {
+      sum += value;
+    }
+    REQUIRE(sum > 0);
+  }
+  BENCHMARK("iteration n=" + std::to_string(n)) {
+    long long sum = 0;
+    for (int value : c) {
+      sum += value;
+    }
+    return sum;
+  };
+
+  if constexpr (requires { c.scan([](auto) {}); }) {
+    const auto scan_sum = [&c] {
+      long long sum = 0;
+      c.scan([&sum](std::span<const int* const> batch) {
+        for (const int* value : batch) {
+          sum += *value;
+        }
+      });
+      return sum;
+    };
+    {
+      PassReport report("scan", name, n, n);
+      REQUIRE(scan_sum() > 0);
+    }
+    BENCHMARK("scan n=" + std::to_string(n)) {
+      return scan_sum();
+    };
+  }
+
+  {
+    C copy = c;
+    PassReport report("erase", name, n, n);
+    for (int key : lookups) {
+      copy.erase(key);
+    }
+  }
+  BENCHMARK_ADVANCED("erase n=" + std::to_string(n))(Catch::Benchmark::Chronometer meter) {
+    std::vector<C> copies(static_cast<std::size_t>(meter.runs()), c);
+    meter.measure([&](int run) {
+      C& copy = copies[static_cast<std::size_t>(run)];
+      for (int key : lookups) {
+        copy.erase(key);
+      }
+      return copy.size();
+    });
+  };
+
+  {
+    std::size_t bytes_before = allocated_bytes();
+    PassReport report("copy", name, n, n);
+    C copy = c;
+    report.set_bytes_per_element(static_cast<double>(allocated_bytes() - bytes_before) / static_cast<double>(n));
+  }
+  BENCHMARK("copy n=" + std::to_string(n)) {
+    return C(c);
+  };
+
+  C other = build<C>(ascending_keys(n));
+  bench_per_op<C>("swap", n, [&](std::size_t) {
+    using std::swap;
+    swap(c, other);
+    return c.size();
+  });
+
+  bench_mixed("mixed 90% reads", c, lookups, 1);
+  bench_mixed("mixed 50% reads", c, lookups, 5);
+
+  // The mixed workloads have left `c` scattered over the heap, as in a long-lived container.
+  if constexpr (requires { c.compact(ct::invalidate_iterators); }) {
+    c.compact(ct::invalidate_iterators, ct::CompactOrder::van_emde_boas);
+    bench_per_op<C>("find hit vEB", n, [&](std::size_t i) { return c.find(lookups[i]) != c.end(); });
+
+    c.compact(ct::invalidate_iterators, ct::CompactOrder::in_order);
+    {
+      PassReport report("iteration compacted", name, n, n);
+      long long sum = 0;
+      for (int value : c) {
+        sum += value;
+      }
+      REQUIRE(sum > 0);
+    }
+    BENCHMARK("iteration compacted n=" + std::to_string(n)) {
+      long long sum = 0;
+      for (int value : c) {
+        sum += value;
+      }
+      return sum;
+    };
+  }
+}
+
+// Strings order through `operator<=>`, so an insertion compares once per level where two `operator<` calls used to
+// tell equal keys apart. Key prefixes spare a search the string buffers of the keys it passes, but only where the
+// keys differ early.
+TEMPLATE_TEST_CASE("String keys", "[bench]", ct::Treap<std::string>, PrefixedStringTreap, std::set<std::string>) {
+  using C = TestType;
+
+  std::size_t n = GENERATE(Catch::Generators::from_range(bench_sizes()));
+  for (bool shared_start : {true, false}) {
+    std::vector<std::string> keys = string_keys(random_keys(n, 1348), shared_start);
+
+    bench_insert<C>(shared_start ? "insert strings shared" : "insert strings", keys);
+
+    C c = build<C>(keys);
+    std::vector<std::string> lookups = string_keys(random_keys(n, 1349), shared_start);
+    bench_per_op<C>(shared_start ? "find strings shared" : "find strings", n, [&](std::size_t i) {
+      return c.find(lookups[i]) != c.end();
+    });
+  }
+}
+
+} // namespace ct_bench
@@ -0,0 +1,125 @@
+#include "perf-counters.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ct_bench {
+
+#ifdef __linux__
+
+namespace {
+
+struct PerfEventConfig {
+  std::uint32_t type;
+  std::uint64_t config;
+};
+
+constexpr std::uint64_t cache_read_miss(std::uint64_t cache) noexcept {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+// Indexed by `PerfEvent`.
+constexpr std::array<PerfEventConfig, perf_event_count> event_configs = {{
+    {PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, cache_read_miss(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+}};
+
+int open_event(const PerfEventConfig& event) noexcept {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+} // namespace
+
+PerfCounters::PerfCounters() noexcept {
+  for (std::size_t i = 0; i < perf_event_count; ++i) {
+    fds[i] = open_event(event_configs[i]);
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (int fd : fds) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+}
+
+void PerfCounters::start() noexcept {
+  for (int fd : fds) {
+    if (fd >= 0) {
+      ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+PerfCounts PerfCounters::stop() noexcept {
+  for (int fd : fds) {
+    if (fd >= 0) {
+      ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+
+  PerfCounts result;
+  for (std::size_t i = 0; i < perf_event_count; ++i) {
+    // value, time enabled, time running
+    std::array<std::uint64_t, 3> data{};
+    if (fds[i] < 0 || ::read(fds[i], data.data(), sizeof(data)) != static_cast<ssize_t>(sizeof(data)) ||
+        data[2] == 0) {
+      continue;
+    }
+    auto scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+    result[i] = static_cast<std::uint64_t>(static_cast<double>(data[0]) * scale);
+  }
+  return result;
+}
+
+#else
+
+PerfCounters::PerfCounters() noexcept {
+  fds.fill(-1);
+}
+
+PerfCounters::~PerfCounters() = default;
+
+void PerfCounters::start() noexcept {}
+
+PerfCounts PerfCounters::stop() noexcept {
+  return {};
+}
+
+#endif
+
+bool PerfCounters::requested() noexcept {
+  const char* env = std::getenv("CT_BENCH_PERF");
+  return env != nullptr && *env != '\0' && std::strcmp(env, "0") != 0;
+}
+
+bool PerfCounters::available() const noexcept {
+  for (int fd : fds) {
+    if (fd >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace ct_bench
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace ct_bench {
+
+// Hardware events counted around a pass when `CT_BENCH_PERF` is set. Cache and TLB misses count loads only.
+enum class PerfEvent : std::uint8_t {
+  l1d_misses,
+  llc_misses,
+  dtlb_misses,
+  branch_misses,
+};
+
+inline constexpr std::size_t perf_event_count = 4;
+
+constexpr std::string_view to_string(PerfEvent event) noexcept {
+  constexpr std::array<std::string_view, perf_event_count> names = {
+      "L1d-miss", "LLC-miss", "dTLB-miss", "br-miss",
+  };
+  return names[static_cast<std::size_t>(event)];
+}
+
+// Totals of one counting interval. An event is empty when the kernel or the CPU does not provide it, or when it was
+// never scheduled on a counter during the interval.
+using PerfCounts = std::array<std::optional<std::uint64_t>, perf_event_count>;
+
+// Counts `PerfEvent`s of the calling thread in user space through Linux `perf_event_open`. Every event is opened on
+// its own, so a CPU lacking one of them still reports the others. Where perf events are not available at all (other
+// systems, containers without the syscall, `perf_event_paranoid` above 2) every count is empty and nothing fails.
+class PerfCounters {
+public:
+  PerfCounters() noexcept;
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  ~PerfCounters();
+
+  // Whether `CT_BENCH_PERF` asks for hardware counters in bench reports.
+  static bool requested() noexcept;
+
+  // True if at least one event could be opened.
+  bool available() const noexcept;
+
+  // Zeroes and starts all counters.
+  void start() noexcept;
+
+  // Stops all counters and returns their totals since `start`, scaled up if the kernel had to multiplex them.
+  PerfCounts stop() noexcept;
+
+private:
+  std::array<int, perf_event_count> fds;
+};
+
+} // namespace ct_bench
@@ -0,0 +1,489 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ct {
+
+// Range `add` is available when `T{}` is the neutral element of a non-throwing `+=`.
+template <typename T>
+concept LazyAddable = std::is_nothrow_default_constructible_v<T> && requires(T& a, const T& b) {
+  { a += b } noexcept;
+};
+
+namespace detail {
+
+struct NoPendingAdd {};
+
+template <typename T, typename Priority>
+struct ImplicitTreapNode {
+  using Pending = std::conditional_t<LazyAddable<T>, T, NoPendingAdd>;
+
+  template <typename... Args>
+  explicit ImplicitTreapNode(Priority priority, Args&&... args)
+      : value(std::forward<Args>(args)...)
+      , priority(priority) {}
+
+  ImplicitTreapNode* left = nullptr;
+  ImplicitTreapNode* right = nullptr;
+  T value;
+  Priority priority;
+  std::size_t size = 1;
+  bool reversed = false;
+  [[no_unique_address]] Pending pending{};
+};
+
+} // namespace detail
+
+// A sequence container indexed by position. Positions are never stored: every node keeps the size of its subtree,
+// and a range `[l, r)` is cut out with two splits. Reversal and addition are recorded as tags on the cut-out root
+// and pushed down lazily when a later operation descends through it.
+//
+// Const access never pushes tags: it carries the reversal and the pending addition down the search path instead, so
+// the tree is left untouched and may be read from several threads. For addable `T` the stored value may still lack
+// an ancestor's pending addition, so const access returns elements by value.
+template <typename T, std::uniform_random_bit_generator RandGen = std::mt19937>
+class ImplicitTreap : RandGen {
+  static_assert(!std::is_const_v<T>, "T must be non-const");
+  static_assert(std::is_copy_constructible_v<T>, "T must have a copy constructor");
+  static_assert(std::is_nothrow_move_constructible_v<T>, "T must have a non-throwing move constructor");
+  static_assert(
+      std::is_nothrow_copy_constructible_v<RandGen>,
+      "Random Generator must have a non-throwing copy constructor"
+  );
+  static_assert(
+      std::is_nothrow_move_constructible_v<RandGen>,
+      "Random Generator must have a non-throwing move constructor"
+  );
+  static_assert(std::is_nothrow_swappable_v<RandGen>, "Random Generator must have a non-throwing swap");
+
+  using Priority = std::invoke_result_t<RandGen&>;
+  using Node = detail::ImplicitTreapNode<T, Priority>;
+
+  class InOrderIterator;
+
+public:
+  using ValueType = T;
+
+  using Reference = T&;
+  using ConstReference = std::conditional_t<LazyAddable<T>, T, const T&>;
+
+  using ConstIterator = InOrderIterator;
+
+public:
+  ImplicitTreap() noexcept = default;
+
+  explicit ImplicitTreap(const RandGen& rg) noexcept
+      : RandGen(rg) {}
+
+  ImplicitTreap(const ImplicitTreap& other)
+      : RandGen(other.rng())
+      , root(copy_subtree(other.root)) {}
+
+  ImplicitTreap(ImplicitTreap&& other) noexcept
+      : RandGen(std::move(other.rng()))
+      , root(std::exchange(other.root, nullptr)) {}
+
+  ImplicitTreap& operator=(const ImplicitTreap& other) {
+    if (this != &other) {
+      ImplicitTreap copy(other);
+      swap(*this, copy);
+    }
+    return *this;
+  }
+
+  ImplicitTreap& operator=(ImplicitTreap&& other) noexcept {
+    if (this != &other) {
+      ImplicitTreap moved(std::move(other));
+      swap(*this, moved);
+    }
+    return *this;
+  }
+
+  ~ImplicitTreap() {
+    clear();
+  }
+
+  void clear() noexcept {
+    destroy_subtree(root);
+    root = nullptr;
+  }
+
+  std::size_t size() const noexcept {
+    return size_of(root);
+  }
+
+  bool empty() const noexcept {
+    return root == nullptr;
+  }
+
+  // Iterators walk the tree in order with an explicit stack, so a full pass costs O(n) and one step O(1) amortized.
+  ConstIterator begin() const {
+    return ConstIterator(root);
+  }
+
+  ConstIterator end() const noexcept {
+    return ConstIterator();
+  }
+
+  Reference operator[](std::size_t pos) noexcept {
+    return node_at(pos)->value;
+  }
+
+  ConstReference operator[](std::size_t pos) const noexcept {
+    Path path{root, root->reversed, {}};
+    for (;;) {
+      const Node* left = path.child(false);
+      std::size_t left_size = size_of(left);
+      if (pos < left_size) {
+        path = path.descend(left);
+      } else if (pos == left_size) {
+        return path.value();
+      } else {
+        pos -= left_size + 1;
+        path = path.descend(path.child(true));
+      }
+    }
+  }
+
+  void insert_at(std::size_t pos, const T& value) {
+    Priority priority = rng()();
+    insert_node(pos, new Node(priority, value));
+  }
+
+  void insert_at(std::size_t pos, T&& value) {
+    Priority priority = rng()();
+    insert_node(pos, new Node(priority, std::move(value)));
+  }
+
+  void push_back(const T& value) {
+    insert_at(size(), value);
+  }
+
+  void push_back(T&& value) {
+    insert_at(size(), std::move(value));
+  }
+
+  void erase_at(std::size_t pos) noexcept {
+    auto [left, rest] = split(root, pos);
+    auto [middle, right] = split(rest, 1);
+    delete middle;
+    root = merge(left, right);
+  }
+
+  // Keeps `[0, pos)` and returns the elements `[pos, size())` as a separate sequence. A seedable generator is
+  // reseeded from this one for the new sequence, so the two halves do not draw the same priorities.
+  ImplicitTreap split_at(std::size_t pos) noexcept {
+    auto [left, right] = split(root, pos);
+    root = left;
+    ImplicitTreap result(rng());
+    if constexpr (requires(RandGen& rg, Priority seed) { rg.seed(seed); }) {
+      result.rng().seed(rng()());
+    }
+    result.root = right;
+    return result;
+  }
+
+  // Appends all elements of `other`, leaving it empty.
+  void concat(ImplicitTreap&& other) noexcept {
+    root = merge(root, std::exchange(other.root, nullptr));
+  }
+
+  // Reverses the elements `[l, r)`. A range with `r <= l` is empty and leaves the sequence unchanged; `r` past
+  // `size()` stops at the end.
+  void reverse(std::size_t l, std::size_t r) noexcept {
+    with_range(l, r, [](Node* node) { node->reversed = !node->reversed; });
+  }
+
+  // Adds `delta` to the elements `[l, r)`, with the same range rules as `reverse`.
+  void add(std::size_t l, std::size_t r, const T& delta) noexcept
+    requires (LazyAddable<T>)
+  {
+    with_range(l, r, [&delta](Node* node) { apply_add(node, delta); });
+  }
+
+  friend void swap(ImplicitTreap& lhs, ImplicitTreap& rhs) noexcept {
+    using std::swap;
+    swap(lhs.rng(), rhs.rng());
+    swap(lhs.root, rhs.root);
+  }
+
+private:
+  RandGen& rng() noexcept {
+    return *this;
+  }
+
+  const RandGen& rng() const noexcept {
+    return *this;
+  }
+
+  // A node reached without pushing tags: `reversed` already includes the node's own flag and says which child comes
+  // first, and `add` is the sum of the additions still pending on its ancestors.
+  struct Path {
+    const Node* node;
+    bool reversed;
+    [[no_unique_address]] typename Node::Pending add;
+
+    const Node* child(bool second) const noexcept {
+      return second != reversed ? node->right : node->left;
+    }
+
+    Path descend(const Node* next) const noexcept {
+      Path result{next, reversed != next->reversed, add};
+      if constexpr (LazyAddable<T>) {
+        result.add += node->pending;
+      }
+      return result;
+    }
+
+    ConstReference value() const noexcept {
+      if constexpr (LazyAddable<T>) {
+        T result = node->value;
+        result += add;
+        return result;
+      } else {
+        return node->value;
+      }
+    }
+  };
+
+  static std::size_t size_of(const Node* node) noexcept {
+    return node == nullptr ? 0 : node->size;
+  }
+
+  static void apply_add(Node* node, const T& delta) noexcept {
+    if (node != nullptr) {
+      node->value += delta;
+      node->pending += delta;
+    }
+  }
+
+  static void push(Node* node) noexcept {
+    if (node->reversed) {
+      std::swap(node->left, node->right);
+      for (Node* child : {node->left, node->right}) {
+        if (child != nullptr) {
+          child->reversed = !child->reversed;
+        }
+      }
+      node->reversed = false;
+    }
+    if constexpr (LazyAddable<T>) {
+      apply_add(node->left, node->pending);
+      apply_add(node->right, node->pending);
+      node->pending = T{};
+    }
+  }
+
+  // Splits `node` into its first `k` elements and the rest. Works top-down in constant space, however tall the
+  // generator makes the tree: a node sent to the left part keeps the `k` elements still owed to that part, a node
+  // sent to the right part loses them.
+  static std::pair<Node*, Node*> split(Node* node, std::size_t k) noexcept {
+    Node* left = nullptr;
+    Node* right = nullptr;
+    Node** left_tail = &left;
+    Node** right_head = &right;
+    k = std::min(k, size_of(node));
+    while (node != nullptr) {
+      push(node);
+      std::size_t left_size = size_of(node->left);
+      if (left_size < k) {
+        node->size = k;
+        *left_tail = node;
+        left_tail = &node->right;
+        k -= left_size + 1;
+        node = node->right;
+      } else {
+        node->size -= k;
+        *right_head = node;
+        right_head = &node->left;
+        node = node->left;
+      }
+    }
+    *left_tail = nullptr;
+    *right_head = nullptr;
+    return {left, right};
+  }
+
+  // Merges two sequences top-down in constant space; a node taken from one side gains all that is left of the other.
+  static Node* merge(Node* left, Node* right) noexcept {
+    Node* result = nullptr;
+    Node** slot = &result;
+    while (left != nullptr && right != nullptr) {
+      if (right->priority < left->priority) {
+        push(left);
+        left->size += right->size;
+        *slot = left;
+        slot = &left->right;
+        left = left->right;
+      } else {
+        push(right);
+        right->size += left->size;
+        *slot = right;
+        slot = &right->left;
+        right = right->left;
+      }
+    }
+    *slot = left != nullptr ? left : right;
+    return result;
+  }
+
+  template <typename F>
+  void with_range(std::size_t l, std::size_t r, F f) noexcept {
+    if (r <= l) {
+      return;
+    }
+    auto [left, rest] = split(root, l);
+    auto [middle, right] = split(rest, r - l);
+    if (middle != nullptr) {
+      f(middle);
+    }
+    root = merge(merge(left, middle), right);
+  }
+
+  void insert_node(std::size_t pos, Node* node) noexcept {
+    auto [left, right] = split(root, pos);
+    root = merge(merge(left, node), right);
+  }
+
+  Node* node_at(std::size_t pos) noexcept {
+    Node* node = root;
+    for (;;) {
+      push(node);
+      std::size_t left_size = size_of(node->left);
+      if (pos < left_size) {
+        node = node->left;
+      } else if (pos == left_size) {
+        return node;
+      } else {
+        pos -= left_size + 1;
+        node = node->right;
+      }
+    }
+  }
+
+  // Copies with an explicit stack of links still to fill, so a tall tree cannot exhaust the call stack. If a copy
+  // throws, the nodes made so far already form a tree and are destroyed.
+  static Node* copy_subtree(const Node* src) {
+    Node* result = nullptr;
+    std::vector<std::pair<const Node*, Node**>> pending;
+    try {
+      if (src != nullptr) {
+        pending.emplace_back(src, &result);
+      }
+      while (!pending.empty()) {
+        auto [from, slot] = pending.back();
+        pending.pop_back();
+        Node* node = new Node(from->priority, from->value);
+        node->size = from->size;
+        node->reversed = from->reversed;
+        node->pending = from->pending;
+        *slot = node;
+        if (from->right != nullptr) {
+          pending.emplace_back(from->right, &node->right);
+        }
+        if (from->left != nullptr) {
+          pending.emplace_back(from->left, &node->left);
+        }
+      }
+    } catch (...) {
+      destroy_subtree(result);
+      throw;
+    }
+    return result;
+  }
+
+  // Rotates left children up until the node has none, then frees it and moves on to its right child. Each rotation
+  // takes one node off the left spine for good, so this runs in linear time and constant space.
+  static void destroy_subtree(Node* node) noexcept {
+    while (node != nullptr) {
+      if (Node* left = node->left; left != nullptr) {
+        node->left = left->right;
+        left->right = node;
+        node = left;
+      } else {
+        delete std::exchange(node, node->right);
+      }
+    }
+  }
+
+private:
+  Node* root = nullptr;
+};
+
+template <typename T, std::uniform_random_bit_generator RandGen>
+class ImplicitTreap<T, RandGen>::InOrderIterator {
+public:
+  using iterator_concept = std::forward_iterator_tag;
+  using iterator_category =
+      std::conditional_t<std::is_reference_v<ConstReference>, std::forward_iterator_tag, std::input_iterator_tag>;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const T*;
+  using reference = ConstReference;
+
+public:
+  InOrderIterator() noexcept = default;
+
+  reference operator*() const noexcept {
+    return stack.back().value();
+  }
+
+  pointer operator->() const noexcept
+    requires (!LazyAddable<T>)
+  {
+    return &stack.back().node->value;
+  }
+
+  InOrderIterator& operator++() {
+    Path top = stack.back();
+    stack.pop_back();
+    if (const Node* next = top.child(true); next != nullptr) {
+      push_first(top.descend(next));
+    }
+    return *this;
+  }
+
+  InOrderIterator operator++(int) {
+    InOrderIterator result = *this;
+    ++*this;
+    return result;
+  }
+
+  friend bool operator==(const InOrderIterator& lhs, const InOrderIterator& rhs) noexcept {
+    return lhs.current() == rhs.current();
+  }
+
+private:
+  explicit InOrderIterator(const Node* root) {
+    if (root != nullptr) {
+      push_first(Path{root, root->reversed, {}});
+    }
+  }
+
+  // Pushes `path` and the chain of first children below it, leaving the first element of the subtree on top.
+  void push_first(Path path) {
+    stack.push_back(path);
+    while (const Node* next = stack.back().child(false)) {
+      stack.push_back(stack.back().descend(next));
+    }
+  }
+
+  const Node* current() const noexcept {
+    return stack.empty() ? nullptr : stack.back().node;
+  }
+
+  friend ImplicitTreap;
+
+private:
+  // The ancestors whose elements are still ahead of the current one; the current element is on top.
+  std::vector<Path> stack;
+};
+
+} // namespace ct
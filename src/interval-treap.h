@@ -0,0 +1,172 @@
+#pragma once
+
+#include "treap.h"
+
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <random>
+#include <ranges>
+#include <type_traits>
+
+namespace ct {
+
+// A closed interval `[lo, hi]`, ordered by `lo` first and `hi` second.
+template <typename K>
+struct Interval {
+  K lo;
+  K hi;
+
+  friend bool operator==(const Interval&, const Interval&) = default;
+  friend auto operator<=>(const Interval&, const Interval&) = default;
+};
+
+template <typename K>
+struct MaxEndpoint {
+  static_assert(std::is_nothrow_copy_constructible_v<K>, "K must have a non-throwing copy constructor");
+
+  using ValueType = std::optional<K>;
+
+  static ValueType identity() noexcept {
+    return std::nullopt;
+  }
+
+  static ValueType lift(const Interval<K>& interval) noexcept {
+    return interval.hi;
+  }
+
+  static ValueType combine(const ValueType& a, const ValueType& b) noexcept {
+    if (!a) {
+      return b;
+    }
+    if (!b) {
+      return a;
+    }
+    return *a < *b ? b : a;
+  }
+};
+
+// Every subtree knows the largest right endpoint inside it, so subtrees that end before the query are skipped
+// entirely and the walk stops at the first interval that starts after it. Only reported intervals and their
+// ancestors are visited.
+template <typename K, std::uniform_random_bit_generator RandGen = std::mt19937>
+class IntervalTreap : public Treap<Interval<K>, RandGen, MaxEndpoint<K>> {
+  using Base = Treap<Interval<K>, RandGen, MaxEndpoint<K>>;
+  using typename Base::NodeBase;
+
+  class OverlapIterator;
+
+public:
+  using IntervalType = Interval<K>;
+  using OverlapRange = std::ranges::subrange<OverlapIterator>;
+
+public:
+  using Base::Base;
+
+  // Intervals containing `point`, in ascending order.
+  OverlapRange stabbing(const K& point) const {
+    return overlapping(point, point);
+  }
+
+  // Intervals intersecting `[lo, hi]`, in ascending order.
+  OverlapRange overlapping(const K& lo, const K& hi) const {
+    const NodeBase* end = this->header();
+    OverlapIterator first(end, lo, hi);
+    first.settle(first.first_in(this->root()));
+    return {first, OverlapIterator(end, lo, hi)};
+  }
+};
+
+template <typename K, std::uniform_random_bit_generator RandGen>
+class IntervalTreap<K, RandGen>::OverlapIterator {
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = Interval<K>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const Interval<K>*;
+  using reference = const Interval<K>&;
+
+public:
+  OverlapIterator() = default;
+
+  reference operator*() const noexcept {
+    return Base::as_node(node)->value;
+  }
+
+  pointer operator->() const noexcept {
+    return &Base::as_node(node)->value;
+  }
+
+  OverlapIterator& operator++() {
+    const NodeBase* next = first_in(node->right);
+    for (const NodeBase* cur = node; next == nullptr && cur != end;) {
+      while (cur->parent->right == cur) {
+        cur = cur->parent;
+      }
+      cur = cur->parent;
+      if (cur == end) {
+        break;
+      }
+      next = reaches(cur) ? cur : first_in(cur->right);
+    }
+    settle(next);
+    return *this;
+  }
+
+  OverlapIterator operator++(int) {
+    OverlapIterator result = *this;
+    ++*this;
+    return result;
+  }
+
+  friend bool operator==(const OverlapIterator& lhs, const OverlapIterator& rhs) noexcept {
+    return lhs.node == rhs.node;
+  }
+
+private:
+  OverlapIterator(const NodeBase* end, const K& lo, const K& hi)
+      : node(end)
+      , end(end)
+      , lo(lo)
+      , hi(hi) {}
+
+  bool reaches(const NodeBase* candidate) const {
+    return !(Base::as_node(candidate)->value.hi < lo);
+  }
+
+  bool subtree_reaches(const NodeBase* subtree) const {
+    auto max = Base::aug_of(subtree);
+    return max && !(*max < lo);
+  }
+
+  void settle(const NodeBase* candidate) {
+    node = candidate != nullptr && !(hi < Base::as_node(candidate)->value.lo) ? candidate : end;
+  }
+
+  // The leftmost interval in `subtree` that ends at or after `lo`, regardless of where it starts.
+  const NodeBase* first_in(const NodeBase* subtree) const {
+    if (!subtree_reaches(subtree)) {
+      return nullptr;
+    }
+    for (;;) {
+      if (subtree_reaches(subtree->left)) {
+        subtree = subtree->left;
+      } else if (reaches(subtree)) {
+        return subtree;
+      } else {
+        subtree = subtree->right;
+      }
+    }
+  }
+
+  friend IntervalTreap;
+
+private:
+  const NodeBase* node = nullptr;
+  const NodeBase* end = nullptr;
+  K lo{};
+  K hi{};
+};
+
+} // namespace ct
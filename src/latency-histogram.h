@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CT_HAS_TSC 1
+#endif
+
+namespace ct {
+
+// Nanoseconds of `std::chrono::steady_clock`.
+struct SteadyClockSource {
+  static constexpr std::string_view unit = "ns";
+
+  static std::uint64_t now() noexcept {
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count());
+  }
+};
+
+#ifdef CT_HAS_TSC
+// Raw time stamp counter ticks. Much cheaper to read than the steady clock, but its rate depends on the CPU, and
+// values taken on different cores are only comparable when the counter is invariant.
+struct TscClockSource {
+  static constexpr std::string_view unit = "cycles";
+
+  static std::uint64_t now() noexcept {
+    return __rdtsc();
+  }
+};
+#endif
+
+// A log-linear histogram in the style of HdrHistogram. Values below 32 get a bucket each; every power of two above
+// is split into 32 equal buckets, so any recorded value is reported with a relative error of at most 1/32. Counts
+// are plain integers, so histograms recorded on different threads are combined with `merge`.
+class LatencyHistogram {
+  static constexpr unsigned sub_bucket_bits = 5;
+  static constexpr std::size_t sub_bucket_count = std::size_t{1} << sub_bucket_bits;
+  static constexpr std::size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+public:
+  void record(std::uint64_t value) noexcept {
+    ++counts[bucket_of(value)];
+    ++total;
+    sum += value;
+    min_value = std::min(min_value, value);
+    max_value = std::max(max_value, value);
+  }
+
+  void merge(const LatencyHistogram& other) noexcept {
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+      counts[i] += other.counts[i];
+    }
+    total += other.total;
+    sum += other.sum;
+    min_value = std::min(min_value, other.min_value);
+    max_value = std::max(max_value, other.max_value);
+  }
+
+  void reset() noexcept {
+    *this = LatencyHistogram();
+  }
+
+  std::uint64_t count() const noexcept {
+    return total;
+  }
+
+  std::uint64_t min() const noexcept {
+    return total == 0 ? 0 : min_value;
+  }
+
+  std::uint64_t max() const noexcept {
+    return max_value;
+  }
+
+  double mean() const noexcept {
+    return total == 0 ? 0 : static_cast<double>(sum) / static_cast<double>(total);
+  }
+
+  // The smallest recorded value such that a fraction `p` of all values is at or below it, up to bucket precision.
+  std::uint64_t percentile(double p) const noexcept {
+    if (total == 0) {
+      return 0;
+    }
+    auto rank = static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(total)));
+    rank = std::clamp<std::uint64_t>(rank, 1, total);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return std::clamp(bucket_upper(i), min_value, max_value);
+      }
+    }
+    return max_value;
+  }
+
+  // One line: count, min, mean, p50, p90, p99, p99.9 and max.
+  void write_text(std::ostream& out, std::string_view unit = "ns") const {
+    out << "count=" << total << " min=" << min() << unit << " mean=" << mean() << unit
+        << " p50=" << percentile(0.5) << unit << " p90=" << percentile(0.9) << unit
+        << " p99=" << percentile(0.99) << unit << " p99.9=" << percentile(0.999) << unit << " max=" << max()
+        << unit;
+  }
+
+  // A JSON object with the summary of `write_text` and the non-empty buckets as `[lowest value, count]` pairs.
+  void write_json(std::ostream& out, std::string_view unit = "ns") const {
+    out << "{\"unit\":\"" << unit << "\",\"count\":" << total << ",\"min\":" << min() << ",\"mean\":" << mean()
+        << ",\"p50\":" << percentile(0.5) << ",\"p90\":" << percentile(0.9) << ",\"p99\":" << percentile(0.99)
+        << ",\"p99.9\":" << percentile(0.999) << ",\"max\":" << max() << ",\"buckets\":[";
+    bool first = true;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+      if (counts[i] != 0) {
+        out << (first ? "" : ",") << '[' << bucket_lower(i) << ',' << counts[i] << ']';
+        first = false;
+      }
+    }
+    out << "]}";
+  }
+
+private:
+  static std::size_t bucket_of(std::uint64_t value) noexcept {
+    if (value < sub_bucket_count) {
+      return static_cast<std::size_t>(value);
+    }
+    auto shift = static_cast<unsigned>(std::bit_width(value)) - 1 - sub_bucket_bits;
+    return (shift + 1) * sub_bucket_count + static_cast<std::size_t>((value >> shift) - sub_bucket_count);
+  }
+
+  static std::uint64_t bucket_lower(std::size_t bucket) noexcept {
+    if (bucket < sub_bucket_count) {
+      return bucket;
+    }
+    std::size_t shift = bucket / sub_bucket_count - 1;
+    return (sub_bucket_count + bucket % sub_bucket_count) << shift;
+  }
+
+  static std::uint64_t bucket_upper(std::size_t bucket) noexcept {
+    return bucket + 1 == bucket_count ? std::numeric_limits<std::uint64_t>::max() : bucket_lower(bucket + 1) - 1;
+  }
+
+private:
+  std::array<std::uint64_t, bucket_count> counts{};
+  std::uint64_t total = 0;
+  std::uint64_t sum = 0;
+  std::uint64_t min_value = std::numeric_limits<std::uint64_t>::max();
+  std::uint64_t max_value = 0;
+};
+
+} // namespace ct
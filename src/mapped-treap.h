@@ -0,0 +1,194 @@
+#pragma once
+
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ct {
+
+// A read-only view of a bitwise snapshot file written by `Treap<T>::save`. The file is mapped shared, so every
+// process that opens the same snapshot uses the same page-cache pages, and queries run directly over the mapping.
+// A snapshot stores the elements as one sorted block, so lookups are binary searches over it and iteration is a
+// linear scan; the image contains no pointers at all.
+template <typename T>
+class MappedTreap {
+  static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+  static_assert(
+      detail::snapshot_header_size % alignof(T) == 0,
+      "Snapshot values are not suitably aligned for T"
+  );
+
+public:
+  using ValueType = T;
+
+  using ConstReference = const T&;
+  using ConstPointer = const T*;
+
+  using ConstIterator = const T*;
+
+public:
+  MappedTreap() noexcept = default;
+
+  // Maps `path` and validates its header. The checksum is left to `verify`, which has to read the whole file.
+  explicit MappedTreap(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "MappedTreap: cannot open " + path);
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), "MappedTreap: cannot stat " + path);
+    }
+    length = static_cast<std::size_t>(st.st_size);
+    if (length < detail::snapshot_header_size + sizeof(std::uint64_t)) {
+      ::close(fd);
+      throw SnapshotError("snapshot: unexpected end of input");
+    }
+
+    void* address = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (address == MAP_FAILED) {
+      throw std::system_error(error, std::generic_category(), "MappedTreap: cannot map " + path);
+    }
+    base = static_cast<const std::byte*>(address);
+
+    try {
+      validate_header();
+    } catch (...) {
+      unmap();
+      throw;
+    }
+  }
+
+  MappedTreap(const MappedTreap&) = delete;
+  MappedTreap& operator=(const MappedTreap&) = delete;
+
+  MappedTreap(MappedTreap&& other) noexcept
+      : base(std::exchange(other.base, nullptr))
+      , length(std::exchange(other.length, 0))
+      , count(std::exchange(other.count, 0)) {}
+
+  MappedTreap& operator=(MappedTreap&& other) noexcept {
+    if (this != &other) {
+      MappedTreap moved(std::move(other));
+      swap(*this, moved);
+    }
+    return *this;
+  }
+
+  ~MappedTreap() {
+    unmap();
+  }
+
+  std::size_t size() const noexcept {
+    return count;
+  }
+
+  bool empty() const noexcept {
+    return count == 0;
+  }
+
+  ConstIterator begin() const noexcept {
+    return data();
+  }
+
+  ConstIterator end() const noexcept {
+    return data() + count;
+  }
+
+  ConstIterator lower_bound(const T& value) const {
+    return std::lower_bound(begin(), end(), value);
+  }
+
+  ConstIterator upper_bound(const T& value) const {
+    return std::upper_bound(begin(), end(), value);
+  }
+
+  ConstIterator find(const T& value) const {
+    ConstIterator it = lower_bound(value);
+    return it == end() || value < *it ? end() : it;
+  }
+
+  bool contains(const T& value) const {
+    return find(value) != end();
+  }
+
+  // Checks the snapshot checksum, touching every page of the file.
+  bool verify() const noexcept {
+    std::size_t payload = length - sizeof(std::uint64_t);
+    detail::Fnv1a checksum;
+    checksum.update(base, payload);
+    std::uint64_t stored;
+    std::memcpy(&stored, base + payload, sizeof(stored));
+    return stored == checksum.digest();
+  }
+
+  friend void swap(MappedTreap& lhs, MappedTreap& rhs) noexcept {
+    std::swap(lhs.base, rhs.base);
+    std::swap(lhs.length, rhs.length);
+    std::swap(lhs.count, rhs.count);
+  }
+
+private:
+  const T* data() const noexcept {
+    return base == nullptr ? nullptr : reinterpret_cast<const T*>(base + detail::snapshot_header_size);
+  }
+
+  template <typename U>
+  U header_field(std::size_t offset) const noexcept {
+    U value;
+    std::memcpy(&value, base + offset, sizeof(U));
+    return value;
+  }
+
+  void validate_header() {
+    constexpr std::size_t magic_size = detail::snapshot_magic.size();
+    if (std::memcmp(base, detail::snapshot_magic.data(), magic_size) != 0) {
+      throw SnapshotError("snapshot: not a treap snapshot");
+    }
+    if (header_field<std::uint32_t>(magic_size) != detail::snapshot_version) {
+      throw SnapshotError("snapshot: unsupported version");
+    }
+    if (header_field<std::uint32_t>(magic_size + 4) != detail::snapshot_bitwise ||
+        header_field<std::uint64_t>(magic_size + 8) != sizeof(T)) {
+      throw SnapshotError("snapshot: layout does not match the container");
+    }
+    auto n = header_field<std::uint64_t>(magic_size + 16);
+    if ((length - detail::snapshot_header_size - sizeof(std::uint64_t)) / sizeof(T) < n ||
+        detail::snapshot_header_size + n * sizeof(T) + sizeof(std::uint64_t) != length) {
+      throw SnapshotError("snapshot: unexpected end of input");
+    }
+    count = static_cast<std::size_t>(n);
+  }
+
+  void unmap() noexcept {
+    if (base != nullptr) {
+      ::munmap(const_cast<std::byte*>(base), length);
+      base = nullptr;
+    }
+  }
+
+private:
+  const std::byte* base = nullptr;
+  std::size_t length = 0;
+  std::size_t count = 0;
+};
+
+} // namespace ct
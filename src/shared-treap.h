@@ -0,0 +1,455 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ct {
+
+namespace detail {
+
+inline constexpr std::array<char, 8> shared_treap_magic = {'C', 'T', 'S', 'H', 'A', 'R', 'E', 'D'};
+inline constexpr std::uint32_t shared_treap_version = 1;
+
+template <typename T>
+struct SharedTreapNode {
+  T value;
+  std::uint64_t priority;
+  std::uint32_t left;
+  std::uint32_t right;
+};
+
+struct SharedTreapHeader {
+  // `shared_treap_magic`, stored last by `create` once everything else is initialized.
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t value_size;
+  std::uint64_t capacity;
+  pthread_rwlock_t lock;
+  std::uint32_t root;
+  std::uint32_t free_list;
+  std::uint64_t used;
+  std::uint64_t size;
+};
+
+} // namespace detail
+
+// A treap whose nodes live in a named POSIX shared memory segment, so several processes on one host can use the
+// same set without copying it. Links are node indices into the segment rather than pointers, so every process may
+// map it at a different address. A process-shared reader-writer lock lets any number of readers run concurrently
+// with each other while writers take turns.
+//
+// The segment has a fixed capacity chosen at creation; inserting into a full treap throws `std::bad_alloc`.
+// Results are returned by value, since references into the segment would outlive the lock.
+//
+// The lock is not robust: a process that dies while holding it, such as a writer killed in the middle of an insert,
+// leaves it held forever and every process attached to the segment blocks on its next operation. A writer also
+// relinks nodes in place, so `operator<` on `T` must not throw; an exception halfway through would leave the shared
+// tree torn for everyone.
+template <typename T, std::uniform_random_bit_generator RandGen = std::mt19937>
+class SharedTreap : RandGen {
+  static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+  static_assert(noexcept(std::declval<const T&>() < std::declval<const T&>()), "T must have a non-throwing operator<");
+  static_assert(
+      std::atomic_ref<std::uint64_t>::is_always_lock_free,
+      "SharedTreap publishes its header with a lock-free 64-bit atomic"
+  );
+  static_assert(
+      std::is_nothrow_move_constructible_v<RandGen>,
+      "Random Generator must have a non-throwing move constructor"
+  );
+
+  using Header = detail::SharedTreapHeader;
+  using Node = detail::SharedTreapNode<T>;
+
+  static constexpr std::uint32_t null = 0;
+
+public:
+  using ValueType = T;
+
+public:
+  // Creates the segment `name` (as for `shm_open`) with room for `capacity` elements. Fails if it already exists.
+  static SharedTreap create(const std::string& name, std::size_t capacity, const RandGen& rg = RandGen()) {
+    if (capacity >= UINT32_MAX) {
+      throw std::length_error("SharedTreap: capacity is too large");
+    }
+
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "SharedTreap: cannot create " + name);
+    }
+    std::size_t length = nodes_offset() + (capacity + 1) * sizeof(Node);
+    if (::ftruncate(fd, static_cast<off_t>(length)) != 0) {
+      int error = errno;
+      ::close(fd);
+      ::shm_unlink(name.c_str());
+      throw std::system_error(error, std::generic_category(), "SharedTreap: cannot resize " + name);
+    }
+
+    SharedTreap result(fd, length, rg, name);
+    Header* header = new (result.base) Header{};
+    header->version = detail::shared_treap_version;
+    header->value_size = sizeof(T);
+    header->capacity = capacity;
+
+    pthread_rwlockattr_t attr;
+    int error = pthread_rwlockattr_init(&attr);
+    if (error == 0) {
+      error = pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+      if (error == 0) {
+        error = pthread_rwlock_init(&header->lock, &attr);
+      }
+      pthread_rwlockattr_destroy(&attr);
+    }
+    if (error != 0) {
+      ::shm_unlink(name.c_str());
+      throw std::system_error(error, std::generic_category(), "SharedTreap: cannot initialize the lock of " + name);
+    }
+
+    // A process that opens the segment concurrently sees no magic until the lock and the header are complete.
+    std::atomic_ref<std::uint64_t>(header->magic).store(magic(), std::memory_order_release);
+    return result;
+  }
+
+  // Attaches to a segment previously made by `create`, possibly in another process.
+  static SharedTreap open(const std::string& name, const RandGen& rg = RandGen()) {
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "SharedTreap: cannot open " + name);
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+      int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), "SharedTreap: cannot stat " + name);
+    }
+
+    SharedTreap result(fd, static_cast<std::size_t>(st.st_size), rg, {});
+    Header& header = result.header();
+    if (result.length < sizeof(Header) ||
+        std::atomic_ref<std::uint64_t>(header.magic).load(std::memory_order_acquire) != magic() ||
+        header.version != detail::shared_treap_version || header.value_size != sizeof(T) ||
+        result.length < nodes_offset() + (header.capacity + 1) * sizeof(Node)) {
+      throw std::runtime_error("SharedTreap: " + name + " is not a compatible segment");
+    }
+    return result;
+  }
+
+  // Removes the name of the segment; processes that still have it mapped keep using it.
+  static void remove(const std::string& name) noexcept {
+    ::shm_unlink(name.c_str());
+  }
+
+  SharedTreap(const SharedTreap&) = delete;
+  SharedTreap& operator=(const SharedTreap&) = delete;
+
+  SharedTreap(SharedTreap&& other) noexcept
+      : RandGen(std::move(other.rng()))
+      , base(std::exchange(other.base, nullptr))
+      , length(std::exchange(other.length, 0)) {}
+
+  SharedTreap& operator=(SharedTreap&& other) noexcept {
+    if (this != &other) {
+      unmap();
+      rng() = std::move(other.rng());
+      base = std::exchange(other.base, nullptr);
+      length = std::exchange(other.length, 0);
+    }
+    return *this;
+  }
+
+  ~SharedTreap() {
+    unmap();
+  }
+
+  std::size_t size() const {
+    ReadLock lock(header());
+    return header().size;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  std::size_t capacity() const noexcept {
+    return header().capacity;
+  }
+
+  bool insert(const T& value) {
+    Priority priority = rng()();
+    WriteLock lock(header());
+    auto [left, right] = split(header().root, value);
+    std::uint32_t equal = leftmost(right);
+    if (equal != null && !(value < node(equal).value)) {
+      header().root = merge(left, right);
+      return false;
+    }
+    std::uint32_t index = allocate();
+    if (index == null) {
+      header().root = merge(left, right);
+      throw std::bad_alloc();
+    }
+    node(index) = Node{value, priority, null, null};
+    header().root = merge(merge(left, index), right);
+    ++header().size;
+    return true;
+  }
+
+  bool erase(const T& value) {
+    WriteLock lock(header());
+    auto [left, rest] = split(header().root, value);
+    std::uint32_t removed = null;
+    rest = detach_leftmost_if(rest, value, removed);
+    header().root = merge(left, rest);
+    if (removed == null) {
+      return false;
+    }
+    deallocate(removed);
+    --header().size;
+    return true;
+  }
+
+  void clear() {
+    WriteLock lock(header());
+    header().root = null;
+    header().free_list = null;
+    header().used = 0;
+    header().size = 0;
+  }
+
+  bool contains(const T& value) const {
+    return find(value).has_value();
+  }
+
+  std::optional<T> find(const T& value) const {
+    std::optional<T> result = lower_bound(value);
+    if (result && value < *result) {
+      return std::nullopt;
+    }
+    return result;
+  }
+
+  std::optional<T> lower_bound(const T& value) const {
+    ReadLock lock(header());
+    std::uint32_t result = null;
+    for (std::uint32_t index = header().root; index != null;) {
+      if (node(index).value < value) {
+        index = node(index).right;
+      } else {
+        result = index;
+        index = node(index).left;
+      }
+    }
+    return result == null ? std::nullopt : std::optional<T>(node(result).value);
+  }
+
+  std::optional<T> upper_bound(const T& value) const {
+    ReadLock lock(header());
+    std::uint32_t result = null;
+    for (std::uint32_t index = header().root; index != null;) {
+      if (value < node(index).value) {
+        result = index;
+        index = node(index).left;
+      } else {
+        index = node(index).right;
+      }
+    }
+    return result == null ? std::nullopt : std::optional<T>(node(result).value);
+  }
+
+  // Calls `f` with every element in ascending order while holding the read lock.
+  template <typename F>
+  void for_each(F f) const {
+    ReadLock lock(header());
+    for_each_in(header().root, f);
+  }
+
+private:
+  using Priority = std::invoke_result_t<RandGen&>;
+
+  class ReadLock {
+  public:
+    explicit ReadLock(Header& header) noexcept
+        : lock(&header.lock) {
+      pthread_rwlock_rdlock(lock);
+    }
+
+    ReadLock(const ReadLock&) = delete;
+    ReadLock& operator=(const ReadLock&) = delete;
+
+    ~ReadLock() {
+      pthread_rwlock_unlock(lock);
+    }
+
+  private:
+    pthread_rwlock_t* lock;
+  };
+
+  class WriteLock {
+  public:
+    explicit WriteLock(Header& header) noexcept
+        : lock(&header.lock) {
+      pthread_rwlock_wrlock(lock);
+    }
+
+    WriteLock(const WriteLock&) = delete;
+    WriteLock& operator=(const WriteLock&) = delete;
+
+    ~WriteLock() {
+      pthread_rwlock_unlock(lock);
+    }
+
+  private:
+    pthread_rwlock_t* lock;
+  };
+
+  SharedTreap(int fd, std::size_t length, const RandGen& rg, const std::string& unlink_on_failure)
+      : RandGen(rg)
+      , length(length) {
+    void* address = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    ::close(fd);
+    if (address == MAP_FAILED) {
+      if (!unlink_on_failure.empty()) {
+        ::shm_unlink(unlink_on_failure.c_str());
+      }
+      throw std::system_error(error, std::generic_category(), "SharedTreap: cannot map segment");
+    }
+    base = static_cast<std::byte*>(address);
+  }
+
+  static constexpr std::uint64_t magic() noexcept {
+    return std::bit_cast<std::uint64_t>(detail::shared_treap_magic);
+  }
+
+  static constexpr std::size_t nodes_offset() noexcept {
+    return (sizeof(Header) + alignof(Node) - 1) / alignof(Node) * alignof(Node);
+  }
+
+  RandGen& rng() noexcept {
+    return *this;
+  }
+
+  Header& header() const noexcept {
+    return *std::launder(reinterpret_cast<Header*>(base));
+  }
+
+  Node& node(std::uint32_t index) const noexcept {
+    return reinterpret_cast<Node*>(base + nodes_offset())[index];
+  }
+
+  std::uint32_t allocate() noexcept {
+    Header& h = header();
+    if (h.free_list != null) {
+      return std::exchange(h.free_list, node(h.free_list).left);
+    }
+    if (h.used == h.capacity) {
+      return null;
+    }
+    return static_cast<std::uint32_t>(++h.used);
+  }
+
+  void deallocate(std::uint32_t index) noexcept {
+    node(index).left = std::exchange(header().free_list, index);
+  }
+
+  // Splits the subtree into elements less than `value` and the rest.
+  std::pair<std::uint32_t, std::uint32_t> split(std::uint32_t index, const T& value) {
+    if (index == null) {
+      return {null, null};
+    }
+    Node& n = node(index);
+    if (n.value < value) {
+      auto [left, right] = split(n.right, value);
+      n.right = left;
+      return {index, right};
+    } else {
+      auto [left, right] = split(n.left, value);
+      n.left = right;
+      return {left, index};
+    }
+  }
+
+  std::uint32_t merge(std::uint32_t left, std::uint32_t right) noexcept {
+    if (left == null) {
+      return right;
+    }
+    if (right == null) {
+      return left;
+    }
+    if (node(right).priority < node(left).priority) {
+      node(left).right = merge(node(left).right, right);
+      return left;
+    } else {
+      node(right).left = merge(left, node(right).left);
+      return right;
+    }
+  }
+
+  std::uint32_t leftmost(std::uint32_t index) const noexcept {
+    if (index == null) {
+      return null;
+    }
+    while (node(index).left != null) {
+      index = node(index).left;
+    }
+    return index;
+  }
+
+  // Unlinks the smallest element of the subtree if it is equivalent to `value`; all its elements are not less.
+  std::uint32_t detach_leftmost_if(std::uint32_t index, const T& value, std::uint32_t& removed) {
+    if (index == null) {
+      return null;
+    }
+    Node& n = node(index);
+    if (n.left != null) {
+      n.left = detach_leftmost_if(n.left, value, removed);
+      return index;
+    }
+    if (value < n.value) {
+      return index;
+    }
+    removed = index;
+    return n.right;
+  }
+
+  template <typename F>
+  void for_each_in(std::uint32_t index, F& f) const {
+    if (index == null) {
+      return;
+    }
+    for_each_in(node(index).left, f);
+    f(static_cast<const T&>(node(index).value));
+    for_each_in(node(index).right, f);
+  }
+
+  void unmap() noexcept {
+    if (base != nullptr) {
+      ::munmap(base, length);
+      base = nullptr;
+    }
+  }
+
+private:
+  std::byte* base = nullptr;
+  std::size_t length = 0;
+};
+
+} // namespace ct
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace ct {
+
+// Snapshot layout, all integers in native byte order:
+//   magic (8 bytes) | version (u32) | flags (u32) | value size (u64) | node count (u64)
+//   | values | multiplicities (u64 each, counted containers only) | FNV-1a checksum of everything before it (u64)
+// Bitwise snapshots store values as one contiguous block of `value size` bytes each; otherwise the layout of
+// every value is up to the serializer.
+struct SnapshotError : std::runtime_error {
+  using runtime_error::runtime_error;
+};
+
+namespace detail {
+
+inline constexpr std::array<char, 8> snapshot_magic = {'C', 'T', 'T', 'R', 'E', 'A', 'P', '\0'};
+inline constexpr std::uint32_t snapshot_version = 1;
+
+inline constexpr std::uint32_t snapshot_bitwise = 1;
+inline constexpr std::uint32_t snapshot_counted = 2;
+
+inline constexpr std::size_t snapshot_header_size =
+    snapshot_magic.size() + 2 * sizeof(std::uint32_t) + 2 * sizeof(std::uint64_t);
+
+// Bitwise blocks are copied through a buffer of about this many bytes, whatever the element count says.
+inline constexpr std::size_t snapshot_chunk_size = 64 * 1024;
+
+class Fnv1a {
+public:
+  void update(const void* data, std::size_t size) noexcept {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; ++i) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3;
+    }
+  }
+
+  std::uint64_t digest() const noexcept {
+    return hash;
+  }
+
+private:
+  std::uint64_t hash = 0xcbf29ce484222325;
+};
+
+} // namespace detail
+
+class SnapshotWriter {
+public:
+  explicit SnapshotWriter(std::ostream& out) noexcept
+      : out(out) {}
+
+  void write(const void* data, std::size_t size) {
+    checksum.update(data, size);
+    if (!out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size))) {
+      throw SnapshotError("snapshot: write failed");
+    }
+  }
+
+  template <typename U>
+    requires (std::is_trivially_copyable_v<U>)
+  void write_value(const U& value) {
+    write(&value, sizeof(U));
+  }
+
+  void finish() {
+    std::uint64_t digest = checksum.digest();
+    write(&digest, sizeof(digest));
+    if (!out.flush()) {
+      throw SnapshotError("snapshot: write failed");
+    }
+  }
+
+private:
+  std::ostream& out;
+  detail::Fnv1a checksum;
+};
+
+class SnapshotReader {
+public:
+  explicit SnapshotReader(std::istream& in) noexcept
+      : in(in) {}
+
+  void read(void* data, std::size_t size) {
+    if (!in.read(static_cast<char*>(data), static_cast<std::streamsize>(size))) {
+      throw SnapshotError("snapshot: unexpected end of input");
+    }
+    checksum.update(data, size);
+  }
+
+  template <typename U>
+    requires (std::is_trivially_copyable_v<U>)
+  U read_value() {
+    std::array<std::byte, sizeof(U)> bytes;
+    read(bytes.data(), bytes.size());
+    return std::bit_cast<U>(bytes);
+  }
+
+  void finish() {
+    std::uint64_t expected = checksum.digest();
+    std::uint64_t actual;
+    if (!in.read(reinterpret_cast<char*>(&actual), sizeof(actual))) {
+      throw SnapshotError("snapshot: unexpected end of input");
+    }
+    if (actual != expected) {
+      throw SnapshotError("snapshot: checksum mismatch");
+    }
+  }
+
+private:
+  std::istream& in;
+  detail::Fnv1a checksum;
+};
+
+// A serializer turns one element into bytes and back. Elements are read back in the order they were written.
+template <typename S, typename T>
+concept SnapshotSerializer = requires(SnapshotWriter& writer, SnapshotReader& reader, const T& value) {
+  S::write(writer, value);
+  { S::read(reader) } -> std::convertible_to<T>;
+};
+
+// Copies the object representation. Snapshots made with it are written and read as a single block.
+template <typename T>
+struct BitwiseSerializer {
+  static_assert(std::is_trivially_copyable_v<T>, "BitwiseSerializer requires a trivially copyable type");
+
+  static void write(SnapshotWriter& writer, const T& value) {
+    writer.write_value(value);
+  }
+
+  static T read(SnapshotReader& reader) {
+    return reader.read_value<T>();
+  }
+};
+
+} // namespace ct
@@ -0,0 +1,330 @@
+#pragma once
+
+#include "latency-histogram.h"
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace ct {
+
+// Public operations that events are attributed to. Work done outside of them, such as copying or loading a
+// container, is attributed to `other`.
+enum class TreapOperation : std::uint8_t {
+  insert,
+  erase,
+  find,
+  lower_bound,
+  clear,
+  other,
+};
+
+inline constexpr std::size_t treap_operation_count = 6;
+
+constexpr std::string_view to_string(TreapOperation op) noexcept {
+  constexpr std::array<std::string_view, treap_operation_count> names = {
+      "insert", "erase", "find", "lower_bound", "clear", "other",
+  };
+  return names[static_cast<std::size_t>(op)];
+}
+
+enum class TreapEvent : std::uint8_t {
+  comparison,
+  node_visit,
+  rotation,
+  allocation,
+  deallocation,
+  rebuild,
+};
+
+struct TreapCounters {
+  std::uint64_t calls = 0;
+  std::uint64_t comparisons = 0;
+  std::uint64_t node_visits = 0;
+  std::uint64_t rotations = 0;
+  std::uint64_t allocations = 0;
+  std::uint64_t deallocations = 0;
+  std::uint64_t rebuilds = 0;
+
+  TreapCounters& operator+=(const TreapCounters& other) noexcept {
+    calls += other.calls;
+    comparisons += other.comparisons;
+    node_visits += other.node_visits;
+    rotations += other.rotations;
+    allocations += other.allocations;
+    deallocations += other.deallocations;
+    rebuilds += other.rebuilds;
+    return *this;
+  }
+
+  friend bool operator==(const TreapCounters&, const TreapCounters&) = default;
+};
+
+// Counters of every operation, indexed by `TreapOperation`.
+class TreapProfile {
+public:
+  TreapCounters& operator[](TreapOperation op) noexcept {
+    return counters[static_cast<std::size_t>(op)];
+  }
+
+  const TreapCounters& operator[](TreapOperation op) const noexcept {
+    return counters[static_cast<std::size_t>(op)];
+  }
+
+  TreapCounters total() const noexcept {
+    TreapCounters result;
+    for (const TreapCounters& c : counters) {
+      result += c;
+    }
+    return result;
+  }
+
+  TreapProfile& operator+=(const TreapProfile& other) noexcept {
+    for (std::size_t i = 0; i < counters.size(); ++i) {
+      counters[i] += other.counters[i];
+    }
+    return *this;
+  }
+
+  friend bool operator==(const TreapProfile&, const TreapProfile&) = default;
+
+private:
+  std::array<TreapCounters, treap_operation_count> counters{};
+};
+
+// An instrumentation policy is told when a public operation starts and ends and about every event in between.
+// `enter` returns a token that is handed back to the matching `leave`, so operations may nest. A policy that keeps
+// events inside the container may also provide `merge(const I&)`: `load` builds the new tree in a temporary
+// container and merges its events back, so that they are not lost with it.
+template <typename I>
+concept TreapInstrumentation =
+    std::is_nothrow_default_constructible_v<I> && requires(I& i, TreapOperation op, TreapEvent event) {
+      { i.enter(op) } noexcept -> std::same_as<TreapOperation>;
+      { i.leave(op) } noexcept;
+      { i.record(event) } noexcept;
+    };
+
+// Does nothing and takes no space, so instrumented code compiles to the same thing as uninstrumented code.
+struct NoInstrumentation {
+  static constexpr TreapOperation enter(TreapOperation) noexcept {
+    return TreapOperation::other;
+  }
+
+  static constexpr void leave(TreapOperation) noexcept {}
+
+  static constexpr void record(TreapEvent) noexcept {}
+};
+
+namespace detail {
+
+class TreapProfiler {
+public:
+  TreapOperation enter(TreapOperation op) noexcept {
+    ++profile[op].calls;
+    return std::exchange(current, op);
+  }
+
+  void leave(TreapOperation previous) noexcept {
+    current = previous;
+  }
+
+  void record(TreapEvent event) noexcept {
+    TreapCounters& c = profile[current];
+    switch (event) {
+    case TreapEvent::comparison:
+      ++c.comparisons;
+      break;
+    case TreapEvent::node_visit:
+      ++c.node_visits;
+      break;
+    case TreapEvent::rotation:
+      ++c.rotations;
+      break;
+    case TreapEvent::allocation:
+      ++c.allocations;
+      break;
+    case TreapEvent::deallocation:
+      ++c.deallocations;
+      break;
+    case TreapEvent::rebuild:
+      ++c.rebuilds;
+      break;
+    }
+  }
+
+  const TreapProfile& snapshot() const noexcept {
+    return profile;
+  }
+
+  void merge(const TreapProfiler& other) noexcept {
+    profile += other.profile;
+  }
+
+  void reset() noexcept {
+    profile = {};
+  }
+
+private:
+  TreapProfile profile;
+  TreapOperation current = TreapOperation::other;
+};
+
+} // namespace detail
+
+// Keeps counters inside the container. A copy or a moved-to container starts with its own zeroed counters.
+// Const operations such as `find` update the counters as well, so a container using this policy must not be read
+// from several threads at once, even though the same container without instrumentation could be.
+class CountingInstrumentation {
+public:
+  CountingInstrumentation() noexcept = default;
+
+  CountingInstrumentation(const CountingInstrumentation&) noexcept {}
+
+  CountingInstrumentation& operator=(const CountingInstrumentation&) noexcept {
+    return *this;
+  }
+
+  TreapOperation enter(TreapOperation op) noexcept {
+    return profiler.enter(op);
+  }
+
+  void leave(TreapOperation previous) noexcept {
+    profiler.leave(previous);
+  }
+
+  void record(TreapEvent event) noexcept {
+    profiler.record(event);
+  }
+
+  const TreapProfile& snapshot() const noexcept {
+    return profiler.snapshot();
+  }
+
+  // Adds the counters of `other` to these.
+  void merge(const CountingInstrumentation& other) noexcept {
+    profiler.merge(other.profiler);
+  }
+
+  void reset() noexcept {
+    profiler.reset();
+  }
+
+private:
+  detail::TreapProfiler profiler;
+};
+
+// Keeps one set of counters per thread, shared by every container using this policy. Cheaper to carry around
+// than `CountingInstrumentation` and safe for containers owned by different threads. Being reachable without a
+// container, it also counts the nodes iterators step through as node visits.
+class ThreadCountingInstrumentation {
+public:
+  static TreapOperation enter(TreapOperation op) noexcept {
+    return profiler().enter(op);
+  }
+
+  static void leave(TreapOperation previous) noexcept {
+    profiler().leave(previous);
+  }
+
+  static void record(TreapEvent event) noexcept {
+    profiler().record(event);
+  }
+
+  // Counters of the calling thread.
+  static const TreapProfile& snapshot() noexcept {
+    return profiler().snapshot();
+  }
+
+  static void reset() noexcept {
+    profiler().reset();
+  }
+
+private:
+  static detail::TreapProfiler& profiler() noexcept {
+    thread_local detail::TreapProfiler instance;
+    return instance;
+  }
+};
+
+// Records how long every outermost operation takes into one histogram per operation. Each histogram is several
+// kilobytes and lives in the container, so this is meant for containers under investigation, not for all of them.
+// A copy or a moved-to container starts with empty histograms. Const operations record their timings too, so a
+// container using this policy must not be read from several threads at once.
+template <typename Clock = SteadyClockSource>
+class TimingInstrumentation {
+public:
+  TimingInstrumentation() noexcept = default;
+
+  TimingInstrumentation(const TimingInstrumentation&) noexcept {}
+
+  TimingInstrumentation& operator=(const TimingInstrumentation&) noexcept {
+    return *this;
+  }
+
+  TreapOperation enter(TreapOperation op) noexcept {
+    if (depth++ == 0) {
+      start = Clock::now();
+    }
+    return std::exchange(current, op);
+  }
+
+  void leave(TreapOperation previous) noexcept {
+    if (--depth == 0) {
+      histograms[static_cast<std::size_t>(current)].record(Clock::now() - start);
+    }
+    current = previous;
+  }
+
+  static void record(TreapEvent) noexcept {}
+
+  const LatencyHistogram& histogram(TreapOperation op) const noexcept {
+    return histograms[static_cast<std::size_t>(op)];
+  }
+
+  // Adds the latencies recorded by `other`, e.g. by a container used on another thread.
+  void merge(const TimingInstrumentation& other) noexcept {
+    for (std::size_t i = 0; i < treap_operation_count; ++i) {
+      histograms[i].merge(other.histograms[i]);
+    }
+  }
+
+  void reset() noexcept {
+    for (LatencyHistogram& h : histograms) {
+      h.reset();
+    }
+  }
+
+  // One line per operation that was timed at least once.
+  void write_text(std::ostream& out) const {
+    for (std::size_t i = 0; i < treap_operation_count; ++i) {
+      if (histograms[i].count() != 0) {
+        out << to_string(static_cast<TreapOperation>(i)) << ' ';
+        histograms[i].write_text(out, Clock::unit);
+        out << '\n';
+      }
+    }
+  }
+
+  // A JSON object keyed by operation name.
+  void write_json(std::ostream& out) const {
+    out << '{';
+    for (std::size_t i = 0; i < treap_operation_count; ++i) {
+      out << (i == 0 ? "" : ",") << '"' << to_string(static_cast<TreapOperation>(i)) << "\":";
+      histograms[i].write_json(out, Clock::unit);
+    }
+    out << '}';
+  }
+
+private:
+  std::array<LatencyHistogram, treap_operation_count> histograms{};
+  std::uint64_t start = 0;
+  unsigned depth = 0;
+  TreapOperation current = TreapOperation::other;
+};
+
+} // namespace ct
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "treap.h"
+
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ct {
+
+namespace detail {
+
+template <typename K, typename V>
+struct MapTraits {
+  using Key = K;
+  using Value = std::pair<const K, V>;
+
+  static constexpr bool counted = false;
+  static constexpr bool mutable_values = true;
+
+  static const Key& key_of(const Value& value) noexcept {
+    return value.first;
+  }
+};
+
+} // namespace detail
+
+// An ordered key-value map. Lookups take a bare key, and values are only constructed once a key is known to be
+// absent.
+template <typename K, typename V, std::uniform_random_bit_generator RandGen = std::mt19937>
+class TreapMap : public detail::TreapEngine<detail::MapTraits<K, V>, RandGen, NoAugmentation> {
+  static_assert(!std::is_const_v<K>, "K must be non-const");
+  static_assert(std::is_copy_constructible_v<K>, "K must have a copy constructor");
+
+  using Base = detail::TreapEngine<detail::MapTraits<K, V>, RandGen, NoAugmentation>;
+
+public:
+  using KeyType = K;
+  using MappedType = V;
+  using ValueType = std::pair<const K, V>;
+
+  using Reference = ValueType&;
+  using ConstReference = const ValueType&;
+
+  using typename Base::ConstIterator;
+  using typename Base::ConstReverseIterator;
+  using typename Base::Iterator;
+  using typename Base::ReverseIterator;
+
+public:
+  using Base::Base;
+
+  std::pair<Iterator, bool> insert(const ValueType& value) {
+    return emplace_impl(value.first, value);
+  }
+
+  std::pair<Iterator, bool> insert(ValueType&& value) {
+    return emplace_impl(value.first, std::move(value));
+  }
+
+  template <typename... Args>
+  std::pair<Iterator, bool> try_emplace(const K& key, Args&&... args) {
+    return emplace_impl(
+        key,
+        std::piecewise_construct,
+        std::forward_as_tuple(key),
+        std::forward_as_tuple(std::forward<Args>(args)...)
+    );
+  }
+
+  template <typename... Args>
+  std::pair<Iterator, bool> try_emplace(K&& key, Args&&... args) {
+    return emplace_impl(
+        key,
+        std::piecewise_construct,
+        std::forward_as_tuple(std::move(key)),
+        std::forward_as_tuple(std::forward<Args>(args)...)
+    );
+  }
+
+  template <typename M>
+  std::pair<Iterator, bool> insert_or_assign(const K& key, M&& mapped) {
+    auto result = try_emplace(key, std::forward<M>(mapped));
+    if (!result.second) {
+      result.first->second = std::forward<M>(mapped);
+    }
+    return result;
+  }
+
+  template <typename M>
+  std::pair<Iterator, bool> insert_or_assign(K&& key, M&& mapped) {
+    auto result = try_emplace(std::move(key), std::forward<M>(mapped));
+    if (!result.second) {
+      result.first->second = std::forward<M>(mapped);
+    }
+    return result;
+  }
+
+  V& operator[](const K& key) {
+    return try_emplace(key).first->second;
+  }
+
+  V& operator[](K&& key) {
+    return try_emplace(std::move(key)).first->second;
+  }
+
+  V& at(const K& key) {
+    auto* node = this->find_node(key);
+    if (node == this->header()) {
+      throw std::out_of_range("TreapMap::at: key not found");
+    }
+    return Base::as_node(node)->value.second;
+  }
+
+  const V& at(const K& key) const {
+    auto* node = this->find_node(key);
+    if (node == this->header()) {
+      throw std::out_of_range("TreapMap::at: key not found");
+    }
+    return Base::as_node(node)->value.second;
+  }
+
+  using Base::erase;
+
+  std::size_t erase(const K& key) {
+    auto* node = this->find_node(key);
+    if (node == this->header()) {
+      return 0;
+    }
+    this->erase_node(Base::as_node(node));
+    return 1;
+  }
+
+private:
+  template <typename... Args>
+  std::pair<Iterator, bool> emplace_impl(const K& key, Args&&... args) {
+    typename Base::Slot slot = this->find_slot(key);
+    if (slot.found != nullptr) {
+      return {Base::iterator_to(slot.found), false};
+    }
+    auto* node = this->create_node(std::forward<Args>(args)...);
+    this->link(slot, node);
+    return {Base::iterator_to(node), true};
+  }
+};
+
+} // namespace ct
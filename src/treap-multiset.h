@@ -0,0 +1,128 @@
+#pragma once
+
+#include "treap.h"
+
+#include <cstddef>
+#include <random>
+#include <type_traits>
+#include <utility>
+
+namespace ct {
+
+namespace detail {
+
+template <typename T>
+struct MultisetTraits : SetTraits<T> {
+  static constexpr bool counted = true;
+};
+
+} // namespace detail
+
+// Equal elements share a single node that counts their occurrences. `size()` counts every occurrence, while
+// iteration visits each distinct element once; use `count` to get its multiplicity.
+template <typename T, std::uniform_random_bit_generator RandGen = std::mt19937>
+class TreapMultiset : public detail::TreapEngine<detail::MultisetTraits<T>, RandGen, NoAugmentation> {
+  static_assert(!std::is_const_v<T>, "T must be non-const");
+  static_assert(std::is_copy_constructible_v<T>, "T must have a copy constructor");
+  static_assert(std::is_nothrow_move_constructible_v<T>, "T must have a non-throwing move constructor");
+
+  using Base = detail::TreapEngine<detail::MultisetTraits<T>, RandGen, NoAugmentation>;
+
+public:
+  using ValueType = T;
+
+  using Reference = T&;
+  using ConstReference = const T&;
+
+  using typename Base::ConstIterator;
+  using typename Base::ConstReverseIterator;
+  using typename Base::Iterator;
+  using typename Base::ReverseIterator;
+
+public:
+  using Base::Base;
+
+  Iterator insert(const T& value, std::size_t n = 1) {
+    return insert_impl(value, n);
+  }
+
+  Iterator insert(T&& value, std::size_t n = 1) {
+    return insert_impl(std::move(value), n);
+  }
+
+  std::size_t count(const T& value) const {
+    auto* node = this->find_node(value);
+    return node == this->header() ? 0 : Base::multiplicity(Base::as_node(node));
+  }
+
+  std::size_t count(ConstIterator pos) const noexcept {
+    return Base::multiplicity(Base::as_node(Base::node_of(pos)));
+  }
+
+  // The number of nodes, i.e. of pairwise distinct elements.
+  std::size_t distinct_size() const noexcept {
+    return this->nodes();
+  }
+
+  // Iteration visits every distinct element once, so `std::distance(begin(), end())` is `distinct_size()`, not
+  // `size()`.
+  using Base::begin;
+  using Base::end;
+
+  // Removes a single occurrence of the element at `pos`. Returns `pos` while other occurrences remain, and the
+  // next element once the last one is gone.
+  Iterator erase(ConstIterator pos) noexcept {
+    auto* node = Base::as_node(Base::node_of(pos));
+    if (Base::multiplicity(node) == 1) {
+      return Base::erase(pos);
+    }
+    auto scope = this->measure(TreapOperation::erase);
+    this->remove_occurrences(node, 1);
+    return Base::iterator_to(node);
+  }
+
+  // Removes every occurrence of `value` and returns how many there were.
+  std::size_t erase(const T& value) {
+    auto* node = this->find_node(value);
+    if (node == this->header()) {
+      return 0;
+    }
+    std::size_t removed = Base::multiplicity(Base::as_node(node));
+    this->erase_node(Base::as_node(node));
+    return removed;
+  }
+
+  // Removes up to `n` occurrences of `value` and returns how many were removed.
+  std::size_t erase(const T& value, std::size_t n) {
+    auto* node = this->find_node(value);
+    if (node == this->header() || n == 0) {
+      return 0;
+    }
+    std::size_t present = Base::multiplicity(Base::as_node(node));
+    if (n >= present) {
+      this->erase_node(Base::as_node(node));
+      return present;
+    }
+    this->remove_occurrences(Base::as_node(node), n);
+    return n;
+  }
+
+private:
+  template <typename U>
+  Iterator insert_impl(U&& value, std::size_t n) {
+    typename Base::Slot slot = this->find_slot(value);
+    if (n == 0) {
+      return Base::iterator_to(slot.found != nullptr ? slot.found : this->header());
+    }
+    if (slot.found != nullptr) {
+      this->add_occurrences(Base::as_node(slot.found), n);
+      return Base::iterator_to(slot.found);
+    }
+    auto* node = this->create_node(std::forward<U>(value));
+    this->link(slot, node);
+    this->add_occurrences(node, n - 1);
+    return Base::iterator_to(node);
+  }
+};
+
+} // namespace ct
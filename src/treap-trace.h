@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace ct {
+
+// Trace layout, all integers in native byte order:
+//   magic (8 bytes) | version (u32) | key size (u32) | records
+// Every record is an operation code (u8) followed by the key, copied bitwise. Records run to the end of the stream.
+struct TraceError : std::runtime_error {
+  using runtime_error::runtime_error;
+};
+
+enum class TraceOp : std::uint8_t {
+  insert,
+  erase,
+  find,
+  lower_bound,
+};
+
+template <typename K>
+struct TraceRecord {
+  TraceOp op;
+  K key;
+};
+
+namespace detail {
+
+inline constexpr std::array<char, 8> trace_magic = {'C', 'T', 'T', 'R', 'A', 'C', 'E', '\0'};
+inline constexpr std::uint32_t trace_version = 1;
+inline constexpr std::size_t trace_op_count = 4;
+
+} // namespace detail
+
+// Reads and validates a trace header, returning the key size it declares.
+inline std::uint32_t read_trace_header(std::istream& in) {
+  std::array<char, detail::trace_magic.size()> magic;
+  std::uint32_t version = 0;
+  std::uint32_t key_size = 0;
+  if (!in.read(magic.data(), magic.size()) || magic != detail::trace_magic) {
+    throw TraceError("trace: not a treap trace");
+  }
+  if (!in.read(reinterpret_cast<char*>(&version), sizeof(version)) ||
+      !in.read(reinterpret_cast<char*>(&key_size), sizeof(key_size))) {
+    throw TraceError("trace: unexpected end of input");
+  }
+  if (version != detail::trace_version) {
+    throw TraceError("trace: unsupported version");
+  }
+  return key_size;
+}
+
+template <typename K>
+class TraceWriter {
+  static_assert(std::is_trivially_copyable_v<K>, "Traced keys must be trivially copyable");
+
+public:
+  explicit TraceWriter(std::ostream& out)
+      : out(out) {
+    std::uint32_t key_size = sizeof(K);
+    put(detail::trace_magic.data(), detail::trace_magic.size());
+    put(&detail::trace_version, sizeof(detail::trace_version));
+    put(&key_size, sizeof(key_size));
+  }
+
+  void write(TraceOp op, const K& key) {
+    put(&op, sizeof(op));
+    put(&key, sizeof(key));
+  }
+
+private:
+  void put(const void* data, std::size_t size) {
+    if (!out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size))) {
+      throw TraceError("trace: write failed");
+    }
+  }
+
+private:
+  std::ostream& out;
+};
+
+template <typename K>
+class TraceReader {
+  static_assert(std::is_trivially_copyable_v<K>, "Traced keys must be trivially copyable");
+
+public:
+  explicit TraceReader(std::istream& in)
+      : in(in) {
+    if (read_trace_header(in) != sizeof(K)) {
+      throw TraceError("trace: key size does not match");
+    }
+  }
+
+  // The next record, or nothing at the end of the trace. Throws `TraceError` on a truncated or malformed record.
+  std::optional<TraceRecord<K>> next() {
+    std::array<std::byte, 1 + sizeof(K)> bytes;
+    in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (in.gcount() == 0 && in.eof()) {
+      return std::nullopt;
+    }
+    if (static_cast<std::size_t>(in.gcount()) != bytes.size()) {
+      throw TraceError("trace: truncated record");
+    }
+    if (static_cast<std::size_t>(bytes[0]) >= detail::trace_op_count) {
+      throw TraceError("trace: unknown operation");
+    }
+
+    TraceRecord<K> record{static_cast<TraceOp>(bytes[0]), {}};
+    std::memcpy(&record.key, bytes.data() + 1, sizeof(K));
+    return record;
+  }
+
+private:
+  std::istream& in;
+};
+
+// Forwards lookups and modifications to `container`, appending each of them to a trace first.
+template <typename Container>
+class TraceRecorder {
+  using Key = typename Container::ValueType;
+
+public:
+  TraceRecorder(Container& container, std::ostream& out)
+      : container(container)
+      , writer(out) {}
+
+  auto insert(const Key& key) {
+    writer.write(TraceOp::insert, key);
+    return container.insert(key);
+  }
+
+  std::size_t erase(const Key& key) {
+    writer.write(TraceOp::erase, key);
+    return container.erase(key);
+  }
+
+  auto find(const Key& key) {
+    writer.write(TraceOp::find, key);
+    return container.find(key);
+  }
+
+  auto lower_bound(const Key& key) {
+    writer.write(TraceOp::lower_bound, key);
+    return container.lower_bound(key);
+  }
+
+  Container& get() noexcept {
+    return container;
+  }
+
+private:
+  Container& container;
+  TraceWriter<Key> writer;
+};
+
+} // namespace ct
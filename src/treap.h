@@ -1,17 +1,545 @@
 #pragma once
 
+#include "snapshot.h"
+#include "treap-instrumentation.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <compare>
+#include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <istream>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <optional>
+#include <ostream>
 #include <random>
+#include <span>
+#include <stdexcept>
+#include <string_view>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace ct {
 
-template <typename T, std::uniform_random_bit_generator RandGen = std::mt19937>
-class Treap : RandGen {
-  static_assert(!std::is_const_v<T>, "T must be non-const");
-  static_assert(std::is_copy_constructible_v<T>, "T must have a copy constructor");
-  static_assert(std::is_nothrow_move_constructible_v<T>, "T must have a non-throwing move constructor");
+// An augmentation is a monoid over `T`: `lift` maps an element to the monoid, `combine` is associative and
+// `identity` is its neutral element. The combined value of every subtree is kept in its root.
+template <typename A, typename T>
+concept TreapAugmentation = requires(const T& value, const typename A::ValueType& a) {
+  { A::identity() } noexcept -> std::convertible_to<typename A::ValueType>;
+  { A::lift(value) } noexcept -> std::convertible_to<typename A::ValueType>;
+  { A::combine(a, a) } noexcept -> std::convertible_to<typename A::ValueType>;
+};
+
+struct NoAugmentation {
+  struct ValueType {};
+
+  static ValueType identity() noexcept {
+    return {};
+  }
+
+  static ValueType lift(const auto&) noexcept {
+    return {};
+  }
+
+  static ValueType combine(ValueType, ValueType) noexcept {
+    return {};
+  }
+};
+
+// Node layouts. `PlainLayout` keeps only the tree links, so stepping an iterator walks up to O(log n) of them.
+// `ThreadedLayout` adds two pointers per node that chain the nodes in order, which makes every increment and
+// decrement a single load. `HotColdLayout` splits every node in two: the child links and the element, which a
+// search reads on every level, form a dense hot record, while the parent link, the priority and the augmentation,
+// which only updates need, go to a cold record in a parallel array. With `int` elements and the default generator a
+// hot record takes 24 bytes where a plain node takes 40. The nodes come from large blocks, which are returned only
+// by `clear` and the destructor.
+struct PlainLayout {};
+struct ThreadedLayout {};
+struct HotColdLayout {};
+
+template <typename L>
+concept TreapLayout =
+    std::same_as<L, PlainLayout> || std::same_as<L, ThreadedLayout> || std::same_as<L, HotColdLayout>;
+
+// A key prefix summarizes every key in a small value that nodes store next to their child links, so that a search
+// can tell most keys apart without reading them. `of` must agree with the order of the keys wherever it tells them
+// apart: `of(a) < of(b)` implies `a < b`. Keys with equal prefixes are compared in full. `NoKeyPrefix` stores
+// nothing and compares every key in full.
+template <typename P, typename Key>
+concept TreapKeyPrefix =
+    std::three_way_comparable<typename P::ValueType, std::weak_ordering> && requires(const Key& key) {
+      { P::of(key) } noexcept -> std::same_as<typename P::ValueType>;
+    };
+
+struct NoKeyPrefix {
+  struct ValueType {
+    friend auto operator<=>(ValueType, ValueType) = default;
+  };
+
+  static ValueType of(const auto&) noexcept {
+    return {};
+  }
+};
+
+// The first `Bytes` bytes of a string, zero-padded and packed big-endian into integers, so that comparing the
+// integers compares the bytes in the order `std::string` does. It saves a search from loading the characters of
+// every key it passes, which for long strings live in a separate heap block; sets of URLs or paths that share a
+// long common start gain little unless `Bytes` reaches past it.
+template <std::size_t Bytes = 8>
+  requires (Bytes == 8 || Bytes == 16)
+struct StringKeyPrefix {
+  using ValueType = std::array<std::uint64_t, Bytes / 8>;
+
+  static ValueType of(std::string_view key) noexcept {
+    std::array<unsigned char, Bytes> bytes{};
+    std::memcpy(bytes.data(), key.data(), std::min(key.size(), Bytes));
+    ValueType prefix{};
+    for (std::size_t i = 0; i < Bytes; ++i) {
+      prefix[i / 8] = prefix[i / 8] << 8 | bytes[i];
+    }
+    return prefix;
+  }
+};
+
+// Filter policies. `NoFilter` sends every lookup down the tree. `BloomFilter` keeps a blocked Bloom filter of the
+// keys next to the tree, which turns most lookups of absent keys away before they read a single node. Every key
+// sets 8 bits in one 64-byte block, so a probe reads one cache line, and its 8 bit tests are a branch-free loop that
+// compilers vectorize. Keys need a non-throwing `std::hash`.
+struct NoFilter {};
+
+struct BloomFilterOptions {
+  // The rate at which absent keys pass once the filter holds as many keys as it was sized for. It is then rebuilt
+  // for twice the current size, so at 1% it takes between 1.2 and 2.4 bytes per element.
+  double false_positive_rate = 0.01;
+  // Erased keys keep passing until the filter is rebuilt, which happens once they exceed this share of the elements.
+  double max_erased_fraction = 0.25;
+};
+
+class BloomFilter {
+public:
+  // Keys a rebuilt filter makes room for at least.
+  static constexpr std::size_t min_keys = 64;
+
+  const BloomFilterOptions& options() const noexcept {
+    return opts;
+  }
+
+  // Takes effect at the next rebuild. Throws `std::invalid_argument` unless both values lie strictly between 0 and 1.
+  void set_options(const BloomFilterOptions& options) {
+    if (!(options.false_positive_rate > 0 && options.false_positive_rate < 1) ||
+        !(options.max_erased_fraction > 0 && options.max_erased_fraction < 1)) {
+      throw std::invalid_argument("BloomFilter: options out of range");
+    }
+    opts = options;
+  }
+
+  // The rate at which absent keys pass now, estimated from the keys added since the last rebuild.
+  double false_positive_rate() const noexcept {
+    if (blocks.empty()) {
+      return 1;
+    }
+    auto bits = static_cast<double>(block_bits * blocks.size());
+    return std::pow(-std::expm1(-static_cast<double>(probes * added) / bits), probes);
+  }
+
+  std::size_t memory_usage() const noexcept {
+    return blocks.size() * sizeof(Block);
+  }
+
+  // False only if no key with this hash was added since the last rebuild.
+  bool may_contain(std::size_t hash) const noexcept {
+    if (blocks.empty()) {
+      return true;
+    }
+    std::uint64_t h = mix(hash);
+    const Block& block = blocks[block_of(h)];
+    std::uint64_t missing = 0;
+    for (std::size_t i = 0; i < probes; ++i) {
+      missing |= mask_of(h, i) & ~block[i];
+    }
+    return missing == 0;
+  }
+
+  void add(std::size_t hash) noexcept {
+    ++added;
+    if (blocks.empty()) {
+      return;
+    }
+    std::uint64_t h = mix(hash);
+    Block& block = blocks[block_of(h)];
+    for (std::size_t i = 0; i < probes; ++i) {
+      block[i] |= mask_of(h, i);
+    }
+  }
+
+  void note_erase() noexcept {
+    ++erased;
+  }
+
+  // Whether the filter should be rebuilt around `size` keys: it holds more keys than it was sized for, or too many
+  // of them were erased.
+  bool stale(std::size_t size) const noexcept {
+    return added > capacity || static_cast<double>(erased) > opts.max_erased_fraction * static_cast<double>(size);
+  }
+
+  // Empties the filter and sizes it for `keys` keys. If the memory cannot be had, the filter keeps its current
+  // blocks, so it stays correct and only lets more absent keys through.
+  void reset(std::size_t keys) noexcept {
+    double bits_per_key = -static_cast<double>(probes) / std::log1p(-std::pow(opts.false_positive_rate, 1.0 / probes));
+    auto count = static_cast<std::size_t>(std::ceil(static_cast<double>(keys) * bits_per_key / block_bits));
+    try {
+      std::vector<Block>(std::max<std::size_t>(count, 1)).swap(blocks);
+    } catch (const std::bad_alloc&) {
+      std::ranges::fill(blocks, Block{});
+    }
+    capacity = keys;
+    added = 0;
+    erased = 0;
+  }
+
+  // Releases the blocks; the next added key triggers a rebuild.
+  void clear() noexcept {
+    std::vector<Block>().swap(blocks);
+    capacity = 0;
+    added = 0;
+    erased = 0;
+  }
+
+  friend void swap(BloomFilter& lhs, BloomFilter& rhs) noexcept {
+    std::swap(lhs.blocks, rhs.blocks);
+    std::swap(lhs.opts, rhs.opts);
+    std::swap(lhs.capacity, rhs.capacity);
+    std::swap(lhs.added, rhs.added);
+    std::swap(lhs.erased, rhs.erased);
+  }
+
+private:
+  static constexpr std::size_t probes = 8;
+  static constexpr std::size_t block_bits = 512;
+
+  struct alignas(64) Block : std::array<std::uint64_t, probes> {};
+
+  // Standard hashes of integers may be the identity, so the bits are spread before use (the MurmurHash3 finalizer).
+  static std::uint64_t mix(std::uint64_t h) noexcept {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ h >> 33;
+  }
+
+  // Maps the high half of the hash onto the blocks without a division.
+  std::size_t block_of(std::uint64_t h) const noexcept {
+    return static_cast<std::size_t>((h >> 32) * blocks.size() >> 32);
+  }
+
+  // One bit of word `i`, picked by the low half of the hash times an odd constant per word.
+  static std::uint64_t mask_of(std::uint64_t h, std::size_t i) noexcept {
+    constexpr std::array<std::uint32_t, probes> salts = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+    };
+    return std::uint64_t{1} << (static_cast<std::uint32_t>(h) * salts[i] >> 26);
+  }
+
+  std::vector<Block> blocks;
+  BloomFilterOptions opts;
+  // Keys the blocks were sized for, and keys added and erased since they were last filled.
+  std::size_t capacity = 0;
+  std::size_t added = 0;
+  std::size_t erased = 0;
+};
+
+template <typename F>
+concept TreapFilter = std::same_as<F, NoFilter> || std::same_as<F, BloomFilter>;
+
+// Memory orders for `compact`. `in_order` stores neighbours in the sorted sequence next to each other, which suits
+// scans. `van_emde_boas` stores the top half of the levels first and then each subtree below them, recursively, so
+// a search touches few cache lines and pages whatever their size.
+enum class CompactOrder : std::uint8_t {
+  in_order,
+  van_emde_boas,
+};
+
+// Passed to `compact` to acknowledge that it moves elements to new addresses.
+struct InvalidateIterators {
+  explicit InvalidateIterators() = default;
+};
+
+inline constexpr InvalidateIterators invalidate_iterators{};
+
+// The shape of a tree at one moment, for monitoring. With random priorities `average_path_length` stays close to
+// `expected_path_length`; a growing gap between them means the tree has degraded.
+struct TreapStats {
+  static constexpr std::size_t cache_line_size = 64;
+  static constexpr std::size_t page_size = 4096;
+
+  std::size_t size = 0;
+  std::size_t nodes = 0;
+  std::size_t node_size = 0;
+  std::size_t memory_usage = 0;
+  std::size_t height = 0;
+  // Times the depth guard found a subtree degenerate and rebuilt it, and the nodes relinked by those rebuilds.
+  std::size_t rebuilds = 0;
+  std::size_t rebuilt_nodes = 0;
+  // `depth_histogram[d]` is the number of nodes at depth `d`; the root is at depth 0.
+  std::vector<std::size_t> depth_histogram;
+  // Nodes visited by a successful search, averaged over all nodes.
+  double average_path_length = 0;
+  // The same average expected of a random binary search tree with as many nodes: 2 (1 + 1/n) H(n) - 3.
+  double expected_path_length = 0;
+  // Distinct cache lines and pages overlapped by nodes, and how densely the nodes fill them. Under `HotColdLayout`
+  // only the hot records count, as those are what a search reads.
+  std::size_t cache_lines = 0;
+  std::size_t pages = 0;
+  double nodes_per_cache_line = 0;
+  double nodes_per_page = 0;
+  // Bytes taken by the `BloomFilter`, which `memory_usage` includes, and the estimated rate at which it lets absent
+  // keys through. Both are 0 without a filter.
+  std::size_t filter_memory = 0;
+  double filter_false_positive_rate = 0;
+};
+
+namespace detail {
+
+// Traits describe how a container built on `TreapEngine` stores its elements: what the nodes hold, which part of
+// it is compared, whether equal keys share a node with a counter, and whether iterators may modify the value.
+template <typename T>
+struct SetTraits {
+  using Key = T;
+  using Value = T;
+
+  static constexpr bool counted = false;
+  static constexpr bool mutable_values = false;
+
+  static const Key& key_of(const Value& value) noexcept {
+    return value;
+  }
+};
+
+// Whether `T` orders through a single `operator<=>` call: a built-in one, or one the type declares. A built-in
+// comparison reached through a conversion operator does not count, as it may disagree with the `operator<` of `T`.
+template <typename T>
+concept ThreeWayOrdered = std::three_way_comparable<T, std::weak_ordering> &&
+                          (std::is_scalar_v<T> || requires(const T& a) { operator<=>(a, a); } ||
+                           requires(const T& a) { a.operator<=>(a); });
+
+// Asks the CPU to start loading `address` into the cache. Never faults, even on null or dangling pointers.
+inline void prefetch(const void* address) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address);
+#else
+  static_cast<void>(address);
+#endif
+}
+
+// `condition ? a : b` computed with a mask, where compilers would otherwise emit a branch.
+template <typename T>
+const T* select(bool condition, const T* a, const T* b) noexcept {
+  std::uintptr_t mask = std::uintptr_t{0} - std::uintptr_t{condition};
+  return reinterpret_cast<const T*>((reinterpret_cast<std::uintptr_t>(a) & mask) |
+                                    (reinterpret_cast<std::uintptr_t>(b) & ~mask));
+}
+
+struct TreapNodeBase {
+  TreapNodeBase* left = nullptr;
+  TreapNodeBase* right = nullptr;
+  TreapNodeBase* parent = nullptr;
+};
+
+// The links of a `HotColdLayout` node that a search follows. The parent link lives in the cold record.
+struct TreapHotNodeBase {
+  TreapHotNodeBase* left = nullptr;
+  TreapHotNodeBase* right = nullptr;
+};
+
+// The sentinel behind `end()`. Its left child is the root, and it is the only node without a parent. It also caches
+// the minimum and the maximum, which are null in an empty tree.
+template <typename NodeBase>
+struct TreapHeader : NodeBase {
+  TreapHeader() noexcept {
+    // Without a parent link to leave null, the sentinel is told apart by its right link, which points to itself.
+    if constexpr (!requires { &NodeBase::parent; }) {
+      this->right = this;
+    }
+  }
+
+  NodeBase* leftmost = nullptr;
+  NodeBase* rightmost = nullptr;
+};
+
+struct NoMultiplicity {};
+
+// In-order neighbours of a node. The ends point to the sentinel.
+struct TreapThreads {
+  TreapNodeBase* prev = nullptr;
+  TreapNodeBase* next = nullptr;
+};
+
+struct NoThreads {};
+
+template <
+    typename Value,
+    typename Priority,
+    typename AugValue,
+    bool counted,
+    bool threaded = false,
+    typename KeyPrefixValue = NoKeyPrefix::ValueType>
+struct TreapNode : TreapNodeBase {
+  template <typename... Args>
+  explicit TreapNode(Priority priority, Args&&... args)
+      : value(std::forward<Args>(args)...)
+      , priority(priority) {}
+
+  // Set by the engine once `value` exists. Placed right after the links, which a search reads as well.
+  [[no_unique_address]] KeyPrefixValue prefix{};
+  Value value;
+  Priority priority;
+  [[no_unique_address]] AugValue aug{};
+  [[no_unique_address]] std::conditional_t<counted, std::size_t, NoMultiplicity> multiplicity{};
+  [[no_unique_address]] std::conditional_t<threaded, TreapThreads, NoThreads> threads{};
+};
+
+template <typename Value, typename KeyPrefixValue = NoKeyPrefix::ValueType>
+struct TreapHotNode : TreapHotNodeBase {
+  template <typename... Args>
+  explicit TreapHotNode(Args&&... args)
+      : value(std::forward<Args>(args)...) {}
+
+  [[no_unique_address]] KeyPrefixValue prefix{};
+  Value value;
+};
+
+template <typename Priority, typename AugValue, bool counted>
+struct TreapColdNode {
+  TreapHotNodeBase* parent = nullptr;
+  Priority priority{};
+  [[no_unique_address]] AugValue aug{};
+  [[no_unique_address]] std::conditional_t<counted, std::size_t, NoMultiplicity> multiplicity{};
+};
+
+// Storage for `HotColdLayout` nodes. Chunks are aligned to their size and hold an array of hot records followed by
+// an array of as many cold records, so the cold record of a node is found from the address of its hot record
+// alone. Freed slots are reused, and the chunks are returned all at once by `release`.
+template <typename Hot, typename Cold>
+class TreapNodePool {
+public:
+  static constexpr std::size_t chunk_size =
+      std::bit_ceil(std::max<std::size_t>(std::size_t{1} << 16, 64 * (sizeof(Hot) + sizeof(Cold))));
+
+  TreapNodePool() noexcept = default;
+
+  TreapNodePool(const TreapNodePool&) = delete;
+  TreapNodePool& operator=(const TreapNodePool&) = delete;
+
+  ~TreapNodePool() {
+    release();
+  }
+
+  // Uninitialized storage for a hot record. Its cold record is at `cold_storage` of the result.
+  Hot* allocate() {
+    if (free_slots != nullptr) {
+      FreeSlot* slot = free_slots;
+      free_slots = slot->next;
+      slot->~FreeSlot();
+      return reinterpret_cast<Hot*>(slot);
+    }
+    if (chunks == nullptr || used == capacity) {
+      auto* chunk = static_cast<Chunk*>(::operator new(chunk_size, std::align_val_t(chunk_size)));
+      chunks = new (chunk) Chunk{chunks};
+      ++chunk_count;
+      used = 0;
+    }
+    return reinterpret_cast<Hot*>(reinterpret_cast<std::byte*>(chunks) + hot_offset + used++ * sizeof(Hot));
+  }
+
+  // Takes back the storage of a hot record whose hot and cold records were both destroyed.
+  void deallocate(Hot* hot) noexcept {
+    free_slots = new (static_cast<void*>(hot)) FreeSlot{free_slots};
+  }
+
+  // Returns every chunk. All nodes must have been destroyed before.
+  void release() noexcept {
+    while (chunks != nullptr) {
+      Chunk* next = chunks->next;
+      ::operator delete(chunks, std::align_val_t(chunk_size));
+      chunks = next;
+    }
+    free_slots = nullptr;
+    chunk_count = 0;
+    used = 0;
+  }
+
+  std::size_t memory_usage() const noexcept {
+    return chunk_count * chunk_size;
+  }
+
+  static void* cold_storage(const Hot* hot) noexcept {
+    auto address = reinterpret_cast<std::uintptr_t>(hot);
+    auto chunk = address & ~(chunk_size - 1);
+    return reinterpret_cast<void*>(chunk + cold_offset + (address - chunk - hot_offset) / sizeof(Hot) * sizeof(Cold));
+  }
+
+  static Cold& cold_of(const Hot* hot) noexcept {
+    return *std::launder(static_cast<Cold*>(cold_storage(hot)));
+  }
+
+  friend void swap(TreapNodePool& lhs, TreapNodePool& rhs) noexcept {
+    std::swap(lhs.chunks, rhs.chunks);
+    std::swap(lhs.free_slots, rhs.free_slots);
+    std::swap(lhs.chunk_count, rhs.chunk_count);
+    std::swap(lhs.used, rhs.used);
+  }
+
+private:
+  struct Chunk {
+    Chunk* next;
+  };
+
+  struct FreeSlot {
+    FreeSlot* next;
+  };
+
+  static constexpr std::size_t round_up(std::size_t n, std::size_t alignment) noexcept {
+    return (n + alignment - 1) / alignment * alignment;
+  }
+
+  static constexpr std::size_t hot_offset = round_up(sizeof(Chunk), alignof(Hot));
+  static constexpr std::size_t capacity = (chunk_size - hot_offset - alignof(Cold)) / (sizeof(Hot) + sizeof(Cold));
+  static constexpr std::size_t cold_offset = round_up(hot_offset + capacity * sizeof(Hot), alignof(Cold));
+
+  static_assert(sizeof(Hot) >= sizeof(FreeSlot) && alignof(Hot) >= alignof(FreeSlot));
+  static_assert(alignof(Hot) <= chunk_size && alignof(Cold) <= chunk_size);
+
+  Chunk* chunks = nullptr;
+  FreeSlot* free_slots = nullptr;
+  std::size_t chunk_count = 0;
+  // Slots handed out from the newest chunk.
+  std::size_t used = 0;
+};
+
+struct NoNodePool {};
+
+// The node storage, rotations, lookups and iteration shared by every treap-based container. Derived containers
+// decide how values get into the tree through `find_slot`, `create_node` and `link`.
+template <
+    typename Traits,
+    std::uniform_random_bit_generator RandGen,
+    typename Augmentation,
+    typename Instrumentation = NoInstrumentation,
+    typename Layout = PlainLayout,
+    typename KeyPrefix = NoKeyPrefix,
+    typename Filter = NoFilter>
+class TreapEngine : RandGen {
   static_assert(
       std::is_nothrow_copy_constructible_v<RandGen>,
       "Random Generator must have a non-throwing copy constructor"
@@ -21,66 +549,1890 @@ class Treap : RandGen {
       "Random Generator must have a non-throwing move constructor"
   );
   static_assert(std::is_nothrow_swappable_v<RandGen>, "Random Generator must have a non-throwing swap");
+  static_assert(
+      !Traits::counted || std::is_same_v<Augmentation, NoAugmentation>,
+      "Counted nodes cannot be augmented"
+  );
 
-public:
-  using ValueType = T;
+protected:
+  using Key = typename Traits::Key;
+  using Value = typename Traits::Value;
+  using Priority = std::invoke_result_t<RandGen&>;
+  using AugValue = typename Augmentation::ValueType;
+  using KeyPrefixValue = typename KeyPrefix::ValueType;
+  static constexpr bool hot_cold = std::is_same_v<Layout, HotColdLayout>;
+  using NodeBase = std::conditional_t<hot_cold, TreapHotNodeBase, TreapNodeBase>;
+  using Node = std::conditional_t<
+      hot_cold,
+      TreapHotNode<Value, KeyPrefixValue>,
+      TreapNode<Value, Priority, AugValue, Traits::counted, std::is_same_v<Layout, ThreadedLayout>, KeyPrefixValue>>;
+  using Header = TreapHeader<NodeBase>;
 
-  using Reference = T&;
-  using ConstReference = const T&;
+  struct Slot {
+    NodeBase* parent;
+    bool to_left;
+    NodeBase* found;
+    // Nodes visited on the way, which `link` checks against the depth guard.
+    std::size_t depth;
+  };
+
+  // Attributes the events recorded during its lifetime to one operation.
+  class OperationScope {
+  public:
+    OperationScope(Instrumentation& probe, TreapOperation op) noexcept
+        : probe(probe)
+        , previous(probe.enter(op)) {}
+
+    OperationScope(const OperationScope&) = delete;
+    OperationScope& operator=(const OperationScope&) = delete;
 
-  using Pointer = void*;
-  using ConstPointer = void*;
+    ~OperationScope() {
+      probe.leave(previous);
+    }
 
-  using Iterator = T*;
-  using ConstIterator = const T*;
+  private:
+    Instrumentation& probe;
+    TreapOperation previous;
+  };
+
+private:
+  static constexpr bool augmented = !std::is_same_v<Augmentation, NoAugmentation>;
+  static constexpr bool threaded = std::is_same_v<Layout, ThreadedLayout>;
+  // Whether searches select the next child without a branch. Comparing built-in numbers is cheap but, on random
+  // keys, as hard to predict as a coin flip, so loading both children and masking one away beats risking a
+  // misprediction on every level.
+  static constexpr bool branchless_descent = std::is_arithmetic_v<Key> && std::is_same_v<KeyPrefix, NoKeyPrefix>;
+  static constexpr bool prefixed = !std::is_same_v<KeyPrefix, NoKeyPrefix>;
+  static constexpr bool filtered = std::is_same_v<Filter, BloomFilter>;
+  // Elements copied at a time when a bitwise snapshot is written or read.
+  static constexpr std::size_t chunk_values = std::max<std::size_t>(1, detail::snapshot_chunk_size / sizeof(Value));
+
+  static_assert(
+      !filtered || std::is_nothrow_invocable_r_v<std::size_t, std::hash<Key>, const Key&>,
+      "BloomFilter needs a non-throwing std::hash of the key"
+  );
+
+  // Holds the parent link, the priority and the augmentation of a node: the node itself, or its cold record.
+  using Cold = std::conditional_t<hot_cold, TreapColdNode<Priority, AugValue, Traits::counted>, Node>;
+  using Pool = std::conditional_t<hot_cold, TreapNodePool<Node, Cold>, NoNodePool>;
+
+  template <bool is_const>
+  class BasicIterator;
+
+public:
+  using Iterator = BasicIterator<!Traits::mutable_values>;
+  using ConstIterator = BasicIterator<true>;
 
   using ReverseIterator = std::reverse_iterator<Iterator>;
   using ConstReverseIterator = std::reverse_iterator<ConstIterator>;
 
 public:
-  Treap() noexcept;
+  TreapEngine() noexcept = default;
+
+  explicit TreapEngine(const RandGen& rg) noexcept
+      : RandGen(rg) {}
+
+  TreapEngine(const TreapEngine& other)
+    requires (std::is_copy_constructible_v<Value>)
+      : RandGen(other.rng())
+      , bloom(other.bloom) {
+    set_root(copy_subtree(other.root(), &sentinel));
+    element_count = other.element_count;
+    node_count = other.node_count;
+    find_ends();
+    thread_nodes();
+  }
+
+  // Declared rather than left out, so that copying a derived container does not fall back to converting it to
+  // the generator base.
+  TreapEngine(const TreapEngine&)
+    requires (!std::is_copy_constructible_v<Value>)
+  = delete;
+
+  TreapEngine(TreapEngine&& other) noexcept
+      : RandGen(std::move(other.rng())) {
+    set_root(std::exchange(other.sentinel.left, nullptr));
+    sentinel.leftmost = std::exchange(other.sentinel.leftmost, nullptr);
+    sentinel.rightmost = std::exchange(other.sentinel.rightmost, nullptr);
+    element_count = std::exchange(other.element_count, 0);
+    node_count = std::exchange(other.node_count, 0);
+    rebuild_count = std::exchange(other.rebuild_count, 0);
+    rebuilt_node_count = std::exchange(other.rebuilt_node_count, 0);
+    slabs = std::move(other.slabs);
+    compact_cursor = std::exchange(other.compact_cursor, nullptr);
+    deep_node.store(other.deep_node.exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+    if constexpr (hot_cold) {
+      swap(pool, other.pool);
+    }
+    if constexpr (filtered) {
+      swap(bloom, other.bloom);
+    }
+    attach_end_threads();
+  }
+
+  TreapEngine& operator=(const TreapEngine& other)
+    requires (std::is_copy_constructible_v<Value>)
+  {
+    if (this != &other) {
+      TreapEngine copy(other);
+      swap(*this, copy);
+    }
+    return *this;
+  }
+
+  TreapEngine& operator=(TreapEngine&& other) noexcept {
+    if (this != &other) {
+      TreapEngine moved(std::move(other));
+      swap(*this, moved);
+    }
+    return *this;
+  }
+
+  ~TreapEngine() {
+    clear();
+  }
+
+  void clear() noexcept {
+    OperationScope scope = measure(TreapOperation::clear);
+    release_nodes();
+  }
+
+  std::size_t size() const noexcept {
+    return element_count;
+  }
+
+  bool empty() const noexcept {
+    return element_count == 0;
+  }
+
+  Iterator begin() noexcept {
+    return Iterator(first());
+  }
+
+  ConstIterator begin() const noexcept {
+    return ConstIterator(first());
+  }
+
+  Iterator end() noexcept {
+    return Iterator(&sentinel);
+  }
+
+  ConstIterator end() const noexcept {
+    return ConstIterator(&sentinel);
+  }
+
+  ReverseIterator rbegin() noexcept {
+    return ReverseIterator(end());
+  }
+
+  ConstReverseIterator rbegin() const noexcept {
+    return ConstReverseIterator(end());
+  }
+
+  ReverseIterator rend() noexcept {
+    return ReverseIterator(begin());
+  }
+
+  ConstReverseIterator rend() const noexcept {
+    return ConstReverseIterator(begin());
+  }
+
+  // Removes the node at `pos` together with all of its occurrences.
+  Iterator erase(ConstIterator pos) noexcept {
+    OperationScope scope = measure(TreapOperation::erase);
+    Iterator next(std::next(pos).node);
+    erase_node(as_node(pos.node));
+    return next;
+  }
+
+  Iterator lower_bound(const Key& key) {
+    OperationScope scope = measure(TreapOperation::lower_bound);
+    return Iterator(lower_bound_node(key));
+  }
+
+  ConstIterator lower_bound(const Key& key) const {
+    OperationScope scope = measure(TreapOperation::lower_bound);
+    return ConstIterator(lower_bound_node(key));
+  }
+
+  Iterator upper_bound(const Key& key) {
+    return Iterator(upper_bound_node(key));
+  }
+
+  ConstIterator upper_bound(const Key& key) const {
+    return ConstIterator(upper_bound_node(key));
+  }
+
+  Iterator find(const Key& key) {
+    OperationScope scope = measure(TreapOperation::find);
+    return Iterator(find_node(key));
+  }
+
+  ConstIterator find(const Key& key) const {
+    OperationScope scope = measure(TreapOperation::find);
+    return ConstIterator(find_node(key));
+  }
+
+  bool contains(const Key& key) const {
+    OperationScope scope = measure(TreapOperation::find);
+    return find_node(key) != &sentinel;
+  }
+
+  // Combines the augmentation values of all elements with keys in `[lo, hi)` in ascending order.
+  AugValue reduce(const Key& lo, const Key& hi) const {
+    using A = Augmentation;
+
+    const NodeBase* fork = root();
+    while (fork != nullptr) {
+      visit();
+      if (less(key_of(fork), lo)) {
+        fork = fork->right;
+      } else if (!less(key_of(fork), hi)) {
+        fork = fork->left;
+      } else {
+        break;
+      }
+    }
+    if (fork == nullptr) {
+      return A::identity();
+    }
+
+    AugValue prefix = A::identity();
+    for (const NodeBase* node = fork->left; node != nullptr;) {
+      visit();
+      if (less(key_of(node), lo)) {
+        node = node->right;
+      } else {
+        prefix = A::combine(A::combine(A::lift(as_node(node)->value), aug_of(node->right)), prefix);
+        node = node->left;
+      }
+    }
+
+    AugValue suffix = A::identity();
+    for (const NodeBase* node = fork->right; node != nullptr;) {
+      visit();
+      if (less(key_of(node), hi)) {
+        suffix = A::combine(suffix, A::combine(aug_of(node->left), A::lift(as_node(node)->value)));
+        node = node->right;
+      } else {
+        node = node->left;
+      }
+    }
+
+    return A::combine(A::combine(prefix, A::lift(as_node(fork)->value)), suffix);
+  }
+
+  // Elements `scan` hands to its callback at a time; only the last batch may be shorter.
+  static constexpr std::size_t scan_batch_size = 64;
 
-  explicit Treap(const RandGen& rg) noexcept;
+  // Calls `f(value)` for every element with a key in `[lo, hi)` in ascending order. Faster than iterating when
+  // nodes are scattered over memory, see `walk`. `f` must not modify the container.
+  template <typename F>
+  void for_each(const Key& lo, const Key& hi, F f) const {
+    walk(lower_bound_scoped(lo), &hi, [&f](const NodeBase* node) { f(as_node(node)->value); });
+  }
 
-  Treap(const Treap& other);
+  // Calls `f(batch)` with a `std::span<const Value* const>` of up to `scan_batch_size` elements at a time, all of
+  // them in ascending order, so that `f` can process each batch in a tight loop. Counted nodes appear once, as in
+  // iteration. `f` must not modify the container.
+  template <typename F>
+  void scan(F f) const {
+    scan_batches(first(), nullptr, f);
+  }
 
-  Treap(Treap&& other) noexcept;
+  // Like `scan()`, restricted to the elements with keys in `[lo, hi)`.
+  template <typename F>
+  void scan(const Key& lo, const Key& hi, F f) const {
+    scan_batches(lower_bound_scoped(lo), &hi, f);
+  }
 
-  Treap& operator=(const Treap& other);
+  // The instrumentation policy, through which its counters are read and reset.
+  Instrumentation& instrumentation() const noexcept {
+    return probe;
+  }
 
-  Treap& operator=(Treap&& other) noexcept;
+  // Times a subtree was rebuilt because an insertion went deeper than the depth guard allows, which only happens
+  // when the random generator hands out poorly distributed priorities.
+  std::size_t rebuilds() const noexcept {
+    return rebuild_count;
+  }
 
-  ~Treap();
+  // Bytes per node, including the cold record under `HotColdLayout`.
+  static constexpr std::size_t node_size() noexcept {
+    return hot_cold ? sizeof(Node) + sizeof(Cold) : sizeof(Node);
+  }
 
-  void clear() noexcept;
+  // Bytes owned by the container: the object itself, including the random generator state, and all of its nodes.
+  // Slots of compacted blocks stay allocated after their elements are erased, until the whole block is empty.
+  std::size_t memory_usage() const noexcept {
+    if constexpr (hot_cold) {
+      return sizeof(TreapEngine) + pool.memory_usage() + filter_memory();
+    }
+    std::size_t vacant = 0;
+    for (const Slab& slab : slabs) {
+      vacant += slab.capacity - slab.live;
+    }
+    return sizeof(TreapEngine) + (node_count + vacant) * sizeof(Node) + filter_memory();
+  }
 
-  std::size_t size() const noexcept;
+  // The Bloom filter in front of `find`, `contains`, `erase` and `extract`, for reading its options and state.
+  const BloomFilter& bloom_filter() const noexcept
+    requires (filtered)
+  {
+    return bloom;
+  }
 
-  bool empty() const noexcept;
+  // Rebuilds the Bloom filter with `options`. Throws `std::invalid_argument` on options out of range.
+  void configure_bloom_filter(const BloomFilterOptions& options)
+    requires (filtered)
+  {
+    bloom.set_options(options);
+    rebuild_filter();
+  }
+
+  // Moves all nodes into one contiguous block in `order`. A tree grown through many scattered insertions and
+  // erasures has its nodes spread all over the heap; afterwards scans or searches touch far fewer cache lines and
+  // pages. Takes O(n log log n) time and O(n) extra memory, and leaves the container unchanged if it throws.
+  //
+  // Every element moves, so all iterators, pointers and references to elements are invalidated, which callers
+  // acknowledge by passing `invalidate_iterators`. Not available with `HotColdLayout`, whose nodes live in the
+  // blocks of its own pool.
+  void compact(InvalidateIterators, CompactOrder order = CompactOrder::in_order)
+    requires (std::is_nothrow_move_constructible_v<Value> && !hot_cold)
+  {
+    if (node_count == 0) {
+      return;
+    }
+    std::vector<Node*> nodes;
+    nodes.reserve(node_count);
+    if (order == CompactOrder::in_order) {
+      for (NodeBase* node = first(); node != &sentinel; node = successor_of(node)) {
+        nodes.push_back(as_node(node));
+      }
+    } else {
+      van_emde_boas_order(root(), height(), nodes);
+    }
+    relocate(nodes);
+    compact_cursor = nullptr;
+  }
+
+  // Moves the next `max_nodes` nodes in ascending order into a block of their own, continuing after the nodes moved
+  // by the previous step, and returns true once a step reaches the maximum. This spreads an in-order compaction
+  // over many short pauses between other operations; nodes inserted meanwhile behind the position of the current
+  // pass are picked up by the next one. Invalidates iterators, pointers and references to the moved elements,
+  // which may be any of them.
+  bool compact_step(InvalidateIterators, std::size_t max_nodes)
+    requires (std::is_nothrow_move_constructible_v<Value> && !hot_cold)
+  {
+    std::vector<Node*> nodes;
+    nodes.reserve(std::min(max_nodes, node_count));
+    NodeBase* node = compact_cursor != nullptr ? compact_cursor : first();
+    for (; node != &sentinel && nodes.size() < max_nodes; node = successor_of(node)) {
+      nodes.push_back(as_node(node));
+    }
+    if (nodes.empty()) {
+      return node == &sentinel;
+    }
+    Node* last = relocate(nodes) + (nodes.size() - 1);
+    NodeBase* next = successor_of(last);
+    compact_cursor = next != &sentinel ? next : nullptr;
+    return compact_cursor == nullptr;
+  }
+
+  // Nodes on the longest root-to-leaf path. Walks the whole tree.
+  std::size_t height() const noexcept {
+    std::size_t result = 0;
+    visit_depths([&result](const NodeBase*, std::size_t depth) { result = std::max(result, depth + 1); });
+    return result;
+  }
+
+  // Walks the whole tree and sorts the node addresses, so it costs O(n log n) time and O(n) memory.
+  TreapStats stats() const {
+    TreapStats result;
+    result.size = element_count;
+    result.nodes = node_count;
+    result.node_size = node_size();
+    result.memory_usage = memory_usage();
+    result.rebuilds = rebuild_count;
+    result.rebuilt_nodes = rebuilt_node_count;
+    if constexpr (filtered) {
+      result.filter_memory = bloom.memory_usage();
+      result.filter_false_positive_rate = bloom.false_positive_rate();
+    }
+    if (node_count == 0) {
+      return result;
+    }
+
+    std::vector<std::uintptr_t> lines;
+    std::vector<std::uintptr_t> pages;
+    std::size_t total_path_length = 0;
+    visit_depths([&](const NodeBase* node, std::size_t depth) {
+      if (result.depth_histogram.size() <= depth) {
+        result.depth_histogram.resize(depth + 1);
+      }
+      ++result.depth_histogram[depth];
+      total_path_length += depth + 1;
+
+      auto first = reinterpret_cast<std::uintptr_t>(as_node(node));
+      auto last = first + sizeof(Node) - 1;
+      for (auto line = first / TreapStats::cache_line_size; line <= last / TreapStats::cache_line_size; ++line) {
+        lines.push_back(line);
+      }
+      for (auto page = first / TreapStats::page_size; page <= last / TreapStats::page_size; ++page) {
+        pages.push_back(page);
+      }
+    });
+    for (auto* ids : {&lines, &pages}) {
+      std::sort(ids->begin(), ids->end());
+      ids->erase(std::unique(ids->begin(), ids->end()), ids->end());
+    }
+
+    auto n = static_cast<double>(node_count);
+    double harmonic = 0;
+    for (std::size_t i = 1; i <= node_count; ++i) {
+      harmonic += 1.0 / static_cast<double>(i);
+    }
+    result.height = result.depth_histogram.size();
+    result.average_path_length = static_cast<double>(total_path_length) / n;
+    result.expected_path_length = 2 * (1 + 1 / n) * harmonic - 3;
+    result.cache_lines = lines.size();
+    result.pages = pages.size();
+    result.nodes_per_cache_line = n / static_cast<double>(lines.size());
+    result.nodes_per_page = n / static_cast<double>(pages.size());
+    return result;
+  }
+
+  // Writes all elements in ascending order in the format described in snapshot.h.
+  template <SnapshotSerializer<Value> Serializer = BitwiseSerializer<Value>>
+  void save(std::ostream& out) const {
+    constexpr bool bitwise = std::is_same_v<Serializer, BitwiseSerializer<Value>>;
+
+    SnapshotWriter writer(out);
+    writer.write(detail::snapshot_magic.data(), detail::snapshot_magic.size());
+    writer.write_value(detail::snapshot_version);
+    writer.write_value(snapshot_flags<bitwise>());
+    writer.write_value<std::uint64_t>(bitwise ? sizeof(Value) : 0);
+    writer.write_value<std::uint64_t>(node_count);
+
+    if constexpr (bitwise) {
+      std::vector<std::byte> block(std::min(node_count, chunk_values) * sizeof(Value));
+      std::byte* pos = block.data();
+      for (const Value& value : *this) {
+        std::memcpy(pos, &value, sizeof(Value));
+        pos += sizeof(Value);
+        if (pos == block.data() + block.size()) {
+          writer.write(block.data(), block.size());
+          pos = block.data();
+        }
+      }
+      writer.write(block.data(), static_cast<std::size_t>(pos - block.data()));
+    } else {
+      for (const Value& value : *this) {
+        Serializer::write(writer, value);
+      }
+    }
+
+    if constexpr (Traits::counted) {
+      for (ConstIterator it = begin(); it != end(); ++it) {
+        writer.write_value<std::uint64_t>(multiplicity(as_node(it.node)));
+      }
+    }
+
+    writer.finish();
+  }
+
+  // Replaces the contents with a snapshot written by `save` with the same serializer. The tree is built bottom-up
+  // from the sorted sequence in linear time. Throws `SnapshotError` on malformed input, leaving the container
+  // unchanged.
+  template <SnapshotSerializer<Value> Serializer = BitwiseSerializer<Value>>
+  void load(std::istream& in) {
+    constexpr bool bitwise = std::is_same_v<Serializer, BitwiseSerializer<Value>>;
+
+    SnapshotReader reader(in);
+    std::array<char, detail::snapshot_magic.size()> magic;
+    reader.read(magic.data(), magic.size());
+    if (magic != detail::snapshot_magic) {
+      throw SnapshotError("snapshot: not a treap snapshot");
+    }
+    if (reader.read_value<std::uint32_t>() != detail::snapshot_version) {
+      throw SnapshotError("snapshot: unsupported version");
+    }
+    if (reader.read_value<std::uint32_t>() != snapshot_flags<bitwise>() ||
+        reader.read_value<std::uint64_t>() != (bitwise ? sizeof(Value) : 0)) {
+      throw SnapshotError("snapshot: layout does not match the container");
+    }
+    auto count = reader.read_value<std::uint64_t>();
+    if (count > std::numeric_limits<std::size_t>::max() / sizeof(Value)) {
+      throw SnapshotError("snapshot: element count out of range");
+    }
+
+    // The count is not trusted to size anything: a snapshot that claims more elements than it holds runs out of
+    // input one chunk at a time.
+    TreapEngine fresh(rng());
+    std::vector<Node*> spine;
+    if constexpr (bitwise) {
+      std::vector<std::byte> block(static_cast<std::size_t>(std::min<std::uint64_t>(count, chunk_values)) *
+                                   sizeof(Value));
+      for (std::uint64_t left = count; left != 0;) {
+        auto n = static_cast<std::size_t>(std::min<std::uint64_t>(left, chunk_values));
+        reader.read(block.data(), n * sizeof(Value));
+        for (const std::byte* pos = block.data(); pos != block.data() + n * sizeof(Value); pos += sizeof(Value)) {
+          std::array<std::byte, sizeof(Value)> bytes;
+          std::memcpy(bytes.data(), pos, sizeof(Value));
+          fresh.append_sorted(std::bit_cast<Value>(bytes), spine);
+        }
+        left -= n;
+      }
+    } else {
+      for (std::uint64_t i = 0; i < count; ++i) {
+        fresh.append_sorted(Serializer::read(reader), spine);
+      }
+    }
+    fresh.finish_sorted(spine);
+
+    if constexpr (Traits::counted) {
+      for (ConstIterator it = fresh.begin(); it != fresh.end(); ++it) {
+        auto n = reader.read_value<std::uint64_t>();
+        if (n == 0) {
+          throw SnapshotError("snapshot: zero multiplicity");
+        }
+        fresh.add_occurrences(as_node(it.node), n - 1);
+      }
+    }
+
+    reader.finish();
+    if constexpr (filtered) {
+      fresh.bloom.set_options(bloom.options());
+      fresh.rebuild_filter();
+    }
+    swap(*this, fresh);
+    // `fresh` now holds the old nodes. Its probe saw the allocations of the new ones and sees the old ones go, and
+    // those events belong to this container.
+    fresh.release_nodes();
+    if constexpr (requires(Instrumentation& into, const Instrumentation& from) { into.merge(from); }) {
+      probe.merge(fresh.probe);
+    }
+  }
+
+  friend void swap(TreapEngine& lhs, TreapEngine& rhs) noexcept {
+    using std::swap;
+    swap(lhs.rng(), rhs.rng());
+    lhs.deep_node.store(
+        rhs.deep_node.exchange(lhs.deep_node.load(std::memory_order_relaxed), std::memory_order_relaxed),
+        std::memory_order_relaxed
+    );
+    swap(lhs.sentinel.left, rhs.sentinel.left);
+    swap(lhs.sentinel.leftmost, rhs.sentinel.leftmost);
+    swap(lhs.sentinel.rightmost, rhs.sentinel.rightmost);
+    swap(lhs.element_count, rhs.element_count);
+    swap(lhs.node_count, rhs.node_count);
+    swap(lhs.rebuild_count, rhs.rebuild_count);
+    swap(lhs.rebuilt_node_count, rhs.rebuilt_node_count);
+    swap(lhs.slabs, rhs.slabs);
+    swap(lhs.compact_cursor, rhs.compact_cursor);
+    if constexpr (hot_cold) {
+      swap(lhs.pool, rhs.pool);
+    }
+    if constexpr (filtered) {
+      swap(lhs.bloom, rhs.bloom);
+    }
+    lhs.set_root(lhs.sentinel.left);
+    rhs.set_root(rhs.sentinel.left);
+    lhs.attach_end_threads();
+    rhs.attach_end_threads();
+  }
+
+protected:
+  NodeBase* root() const noexcept {
+    return sentinel.left;
+  }
+
+  const NodeBase* header() const noexcept {
+    return &sentinel;
+  }
+
+  static Node* as_node(NodeBase* node) noexcept {
+    return static_cast<Node*>(node);
+  }
+
+  static const Node* as_node(const NodeBase* node) noexcept {
+    return static_cast<const Node*>(node);
+  }
+
+  static const Key& key_of(const NodeBase* node) noexcept {
+    return Traits::key_of(as_node(node)->value);
+  }
+
+  static AugValue aug_of(const NodeBase* node) noexcept {
+    return node == nullptr ? Augmentation::identity() : cold_of(node).aug;
+  }
+
+  static Cold& cold_of(NodeBase* node) noexcept {
+    if constexpr (hot_cold) {
+      return Pool::cold_of(as_node(node));
+    } else {
+      return *as_node(node);
+    }
+  }
+
+  static const Cold& cold_of(const NodeBase* node) noexcept {
+    if constexpr (hot_cold) {
+      return Pool::cold_of(as_node(node));
+    } else {
+      return *as_node(node);
+    }
+  }
+
+  static NodeBase*& parent_of(NodeBase* node) noexcept {
+    return cold_of(node).parent;
+  }
+
+  static NodeBase* parent_of(const NodeBase* node) noexcept {
+    return cold_of(node).parent;
+  }
+
+  static bool is_header(const NodeBase* node) noexcept {
+    if constexpr (hot_cold) {
+      return node->right == node;
+    } else {
+      return node->parent == nullptr;
+    }
+  }
+
+  std::size_t nodes() const noexcept {
+    return node_count;
+  }
+
+  static Iterator iterator_to(const NodeBase* node) noexcept {
+    return Iterator(node);
+  }
+
+  static NodeBase* node_of(ConstIterator it) noexcept {
+    return it.node;
+  }
+
+  static std::size_t multiplicity(const Node* node) noexcept {
+    if constexpr (Traits::counted) {
+      return cold_of(node).multiplicity;
+    } else {
+      return 1;
+    }
+  }
+
+  // Finds where `key` is or would be attached. Performs every comparison an insertion needs, so a later `link` of
+  // the same slot cannot throw.
+  Slot find_slot(const Key& key) const {
+    Slot slot{const_cast<Header*>(&sentinel), true, nullptr, 0};
+    KeyPrefixValue prefix = KeyPrefix::of(key);
+    for (NodeBase* node = root(); node != nullptr;) {
+      visit();
+      ++slot.depth;
+      slot.parent = node;
+      std::weak_ordering order = compare(key, prefix, node);
+      if (std::is_lt(order)) {
+        slot.to_left = true;
+        node = node->left;
+      } else if (std::is_gt(order)) {
+        slot.to_left = false;
+        node = node->right;
+      } else {
+        slot.found = node;
+        break;
+      }
+    }
+    return slot;
+  }
+
+  template <typename... Args>
+  Node* create_node(Args&&... args) {
+    Priority priority = rng()();
+    Node* node = new_node(priority, std::forward<Args>(args)...);
+    probe.record(TreapEvent::allocation);
+    if constexpr (Traits::counted) {
+      cold_of(node).multiplicity = 1;
+    }
+    return node;
+  }
+
+  void link(Slot slot, Node* node) noexcept {
+    parent_of(node) = slot.parent;
+    (slot.to_left ? slot.parent->left : slot.parent->right) = node;
+    // Rotations keep the in-order sequence, so only the attachment point decides whether `node` is a new end.
+    if (slot.parent == &sentinel) {
+      sentinel.leftmost = node;
+      sentinel.rightmost = node;
+    } else if (slot.to_left && slot.parent == sentinel.leftmost) {
+      sentinel.leftmost = node;
+    } else if (!slot.to_left && slot.parent == sentinel.rightmost) {
+      sentinel.rightmost = node;
+    }
+    if constexpr (threaded) {
+      // A new leaf sits right next to its parent in the in-order sequence.
+      if (slot.parent == &sentinel) {
+        thread_between(node, &sentinel, &sentinel);
+      } else if (slot.to_left) {
+        thread_between(node, as_node(slot.parent)->threads.prev, slot.parent);
+      } else {
+        thread_between(node, slot.parent, as_node(slot.parent)->threads.next);
+      }
+    }
+    pull(node);
+    element_count += multiplicity(node);
+    ++node_count;
+    if (slot.depth > depth_limit()) {
+      auto [top, size] = find_scapegoat(node);
+      rebuild(top, size);
+    } else {
+      while (parent_of(node) != &sentinel && cold_of(parent_of(node)).priority < cold_of(node).priority) {
+        rotate_up(node);
+      }
+      pull_path(parent_of(node));
+    }
+    if constexpr (filtered) {
+      bloom.add(std::hash<Key>()(key_of(node)));
+      if (bloom.stale(node_count)) {
+        rebuild_filter();
+      }
+    }
+    repair_deep_path();
+  }
+
+  void add_occurrences(Node* node, std::size_t n) noexcept
+    requires (Traits::counted)
+  {
+    cold_of(node).multiplicity += n;
+    element_count += n;
+  }
+
+  void remove_occurrences(Node* node, std::size_t n) noexcept
+    requires (Traits::counted)
+  {
+    cold_of(node).multiplicity -= n;
+    element_count -= n;
+  }
+
+  void erase_node(Node* node) noexcept {
+    destroy_node(unlink_node(node));
+  }
+
+  // Takes `node` out of the tree without destroying it.
+  Node* unlink_node(Node* node) noexcept {
+    repair_deep_path();
+    if (node == compact_cursor) {
+      NodeBase* next = successor_of(node);
+      compact_cursor = next != &sentinel ? next : nullptr;
+    }
+    if constexpr (threaded) {
+      NodeBase* prev = node->threads.prev;
+      NodeBase* next = node->threads.next;
+      if (prev != &sentinel) {
+        as_node(prev)->threads.next = next;
+      } else {
+        sentinel.leftmost = next != &sentinel ? next : nullptr;
+      }
+      if (next != &sentinel) {
+        as_node(next)->threads.prev = prev;
+      } else {
+        sentinel.rightmost = prev != &sentinel ? prev : nullptr;
+      }
+    } else {
+      // The minimum has no left child, so its successor is the leftmost node of its right subtree or else its
+      // parent; the maximum mirrors that.
+      if (node == sentinel.leftmost) {
+        sentinel.leftmost = node->right != nullptr ? leftmost_of(node->right) : real_parent(node);
+      }
+      if (node == sentinel.rightmost) {
+        sentinel.rightmost = node->left != nullptr ? rightmost_of(node->left) : real_parent(node);
+      }
+    }
+    while (node->left != nullptr && node->right != nullptr) {
+      Node* left = as_node(node->left);
+      Node* right = as_node(node->right);
+      rotate_up(cold_of(left).priority < cold_of(right).priority ? right : left);
+    }
+
+    NodeBase* child = node->left != nullptr ? node->left : node->right;
+    NodeBase* parent = parent_of(node);
+    if (child != nullptr) {
+      parent_of(child) = parent;
+    }
+    (parent->left == node ? parent->left : parent->right) = child;
+    pull_path(parent);
+
+    element_count -= multiplicity(node);
+    --node_count;
+    if constexpr (filtered) {
+      bloom.note_erase();
+      if (bloom.stale(node_count)) {
+        rebuild_filter();
+      }
+    }
+    return node;
+  }
+
+  void destroy_node(Node* node) noexcept {
+    free_node(node);
+    probe.record(TreapEvent::deallocation);
+  }
+
+  OperationScope measure(TreapOperation op) const noexcept {
+    return OperationScope(probe, op);
+  }
+
+  NodeBase* find_node(const Key& key) const {
+    if constexpr (filtered) {
+      if (!bloom.may_contain(std::hash<Key>()(key))) {
+        return const_cast<Header*>(&sentinel);
+      }
+    }
+    NodeBase* node = lower_bound_node(key);
+    if (node == &sentinel || less(key, KeyPrefix::of(key), node)) {
+      return const_cast<Header*>(&sentinel);
+    }
+    return node;
+  }
+
+private:
+  RandGen& rng() noexcept {
+    return *this;
+  }
+
+  const RandGen& rng() const noexcept {
+    return *this;
+  }
+
+  bool less(const Key& lhs, const Key& rhs) const {
+    probe.record(TreapEvent::comparison);
+    return lhs < rhs;
+  }
+
+  // Orders `lhs` against `rhs` with one call of `operator<=>` where the key has one, and with up to two calls of
+  // `operator<` otherwise.
+  std::weak_ordering compare(const Key& lhs, const Key& rhs) const {
+    if constexpr (ThreeWayOrdered<Key>) {
+      probe.record(TreapEvent::comparison);
+      return lhs <=> rhs;
+    } else if (less(lhs, rhs)) {
+      return std::weak_ordering::less;
+    } else if (less(rhs, lhs)) {
+      return std::weak_ordering::greater;
+    } else {
+      return std::weak_ordering::equivalent;
+    }
+  }
+
+  // Orders `key`, whose prefix is `prefix`, against the key of `node`. The keys themselves are compared only when
+  // the prefixes tie, and prefix comparisons do not count as comparisons.
+  std::weak_ordering compare(const Key& key, const KeyPrefixValue& prefix, const NodeBase* node) const {
+    if constexpr (prefixed) {
+      std::weak_ordering order = prefix <=> as_node(node)->prefix;
+      if (std::is_neq(order)) {
+        return order;
+      }
+    }
+    return compare(key, key_of(node));
+  }
+
+  bool less(const Key& key, const KeyPrefixValue& prefix, const NodeBase* node) const {
+    if constexpr (prefixed) {
+      std::weak_ordering order = prefix <=> as_node(node)->prefix;
+      if (std::is_neq(order)) {
+        return std::is_lt(order);
+      }
+    }
+    return less(key, key_of(node));
+  }
+
+  bool less(const NodeBase* node, const Key& key, const KeyPrefixValue& prefix) const {
+    if constexpr (prefixed) {
+      std::weak_ordering order = as_node(node)->prefix <=> prefix;
+      if (std::is_neq(order)) {
+        return std::is_lt(order);
+      }
+    }
+    return less(key_of(node), key);
+  }
+
+  void visit() const noexcept {
+    probe.record(TreapEvent::node_visit);
+  }
+
+  void set_root(NodeBase* node) noexcept {
+    sentinel.left = node;
+    if (node != nullptr) {
+      parent_of(node) = &sentinel;
+    }
+  }
+
+  NodeBase* first() const noexcept {
+    return sentinel.leftmost != nullptr ? sentinel.leftmost : const_cast<Header*>(&sentinel);
+  }
+
+  static NodeBase* leftmost_of(NodeBase* node) noexcept {
+    while (node->left != nullptr) {
+      node = node->left;
+    }
+    return node;
+  }
+
+  static NodeBase* rightmost_of(NodeBase* node) noexcept {
+    while (node->right != nullptr) {
+      node = node->right;
+    }
+    return node;
+  }
+
+  NodeBase* real_parent(const NodeBase* node) noexcept {
+    return parent_of(node) == &sentinel ? nullptr : parent_of(node);
+  }
+
+  void find_ends() noexcept {
+    sentinel.leftmost = root() != nullptr ? leftmost_of(root()) : nullptr;
+    sentinel.rightmost = root() != nullptr ? rightmost_of(root()) : nullptr;
+  }
+
+  static NodeBase* successor_of(NodeBase* node) noexcept {
+    if (node->right != nullptr) {
+      return leftmost_of(node->right);
+    }
+    while (parent_of(node)->right == node) {
+      node = parent_of(node);
+    }
+    return parent_of(node);
+  }
+
+  // Puts `node` between `prev` and `next` in the in-order chain; either of them may be the sentinel.
+  void thread_between(Node* node, NodeBase* prev, NodeBase* next) noexcept {
+    node->threads = {prev, next};
+    if (prev != &sentinel) {
+      as_node(prev)->threads.next = node;
+    }
+    if (next != &sentinel) {
+      as_node(next)->threads.prev = node;
+    }
+  }
+
+  // Chains the nodes of a tree that was built without its threads, such as a copy.
+  void thread_nodes() noexcept {
+    if constexpr (threaded) {
+      NodeBase* prev = &sentinel;
+      for (NodeBase* node = first(); node != &sentinel; node = successor_of(node)) {
+        thread_between(as_node(node), prev, &sentinel);
+        prev = node;
+      }
+    }
+  }
+
+  // Points the outer threads of the ends at this sentinel after the nodes were taken over from another container.
+  void attach_end_threads() noexcept {
+    if constexpr (threaded) {
+      if (sentinel.leftmost != nullptr) {
+        as_node(sentinel.leftmost)->threads.prev = &sentinel;
+        as_node(sentinel.rightmost)->threads.next = &sentinel;
+      }
+    }
+  }
+
+  // Calls `f(node, depth)` for every node in preorder, the root being at depth 0. Uses the parent links instead of
+  // a stack.
+  template <typename F>
+  void visit_depths(F f) const {
+    const NodeBase* node = root();
+    std::size_t depth = 0;
+    while (node != nullptr) {
+      f(node, depth);
+      if (node->left != nullptr || node->right != nullptr) {
+        node = node->left != nullptr ? node->left : node->right;
+        ++depth;
+        continue;
+      }
+      for (;;) {
+        const NodeBase* parent = parent_of(node);
+        if (parent == &sentinel) {
+          node = nullptr;
+          break;
+        }
+        if (parent->left == node && parent->right != nullptr) {
+          node = parent->right;
+          break;
+        }
+        node = parent;
+        --depth;
+      }
+    }
+  }
+
+  template <bool bitwise>
+  static constexpr std::uint32_t snapshot_flags() noexcept {
+    return (bitwise ? detail::snapshot_bitwise : 0) | (Traits::counted ? detail::snapshot_counted : 0);
+  }
+
+  // Attaches `value` after the current maximum. `spine` holds the right spine of the tree built so far; its nodes
+  // are the only ones whose augmentation is not final yet.
+  void append_sorted(Value&& value, std::vector<Node*>& spine) {
+    if (!spine.empty() && !less(key_of(spine.back()), Traits::key_of(value))) {
+      throw SnapshotError("snapshot: elements are not in ascending order");
+    }
+    // Grows geometrically: the spine of a degenerate tree holds every node.
+    if (spine.size() == spine.capacity()) {
+      spine.reserve(2 * spine.size() + 1);
+    }
+    Node* node = create_node(std::move(value));
+
+    Node* last = nullptr;
+    while (!spine.empty() && cold_of(spine.back()).priority < cold_of(node).priority) {
+      last = spine.back();
+      spine.pop_back();
+      pull(last);
+    }
+    node->left = last;
+    if (last != nullptr) {
+      parent_of(last) = node;
+    }
+    if constexpr (threaded) {
+      thread_between(node, node_count == 0 ? &sentinel : sentinel.rightmost, &sentinel);
+    }
+    if (node_count == 0) {
+      sentinel.leftmost = node;
+    }
+    sentinel.rightmost = node;
+    if (spine.empty()) {
+      set_root(node);
+    } else {
+      spine.back()->right = node;
+      parent_of(node) = spine.back();
+    }
+    spine.push_back(node);
+
+    element_count += multiplicity(node);
+    ++node_count;
+  }
+
+  std::size_t filter_memory() const noexcept {
+    if constexpr (filtered) {
+      return bloom.memory_usage();
+    } else {
+      return 0;
+    }
+  }
+
+  // Refills the Bloom filter from the elements, sized for twice as many, which drops the keys erased meanwhile.
+  void rebuild_filter() noexcept {
+    bloom.reset(std::max(2 * node_count, BloomFilter::min_keys));
+    for (NodeBase* node = first(); node != &sentinel; node = successor_of(node)) {
+      bloom.add(std::hash<Key>()(key_of(node)));
+    }
+  }
+
+  static void finish_sorted(std::vector<Node*>& spine) noexcept {
+    while (!spine.empty()) {
+      pull(spine.back());
+      spine.pop_back();
+    }
+  }
+
+  const NodeBase* lower_bound_scoped(const Key& key) const {
+    OperationScope scope = measure(TreapOperation::lower_bound);
+    return lower_bound_node(key);
+  }
+
+  // Visits the nodes from `node` on in ascending order, up to the end or to the first key not below `*hi`. Going
+  // down to a left child it prefetches the right one, which the walk reaches once the left subtree is done, so the
+  // loads of several upcoming nodes are in flight at the same time instead of one after another.
+  template <typename OnNode>
+  void walk(const NodeBase* node, const Key* hi, OnNode on_node) const {
+    while (node != &sentinel && (hi == nullptr || less(key_of(node), *hi))) {
+      on_node(node);
+      if (node->right != nullptr) {
+        node = node->right;
+        visit();
+        while (node->left != nullptr) {
+          prefetch(node->right);
+          node = node->left;
+          visit();
+        }
+      } else {
+        while (parent_of(node)->right == node) {
+          node = parent_of(node);
+          visit();
+        }
+        node = parent_of(node);
+        visit();
+      }
+    }
+  }
+
+  template <typename F>
+  void scan_batches(const NodeBase* from, const Key* hi, F& f) const {
+    std::array<const Value*, scan_batch_size> batch;
+    std::size_t count = 0;
+    walk(from, hi, [&](const NodeBase* node) {
+      batch[count++] = &as_node(node)->value;
+      if (count == batch.size()) {
+        f(std::span<const Value* const>(batch.data(), count));
+        count = 0;
+      }
+    });
+    if (count != 0) {
+      f(std::span<const Value* const>(batch.data(), count));
+    }
+  }
+
+  NodeBase* lower_bound_node(const Key& key) const {
+    const NodeBase* result = &sentinel;
+    KeyPrefixValue prefix = KeyPrefix::of(key);
+    const NodeBase* last = nullptr;
+    std::size_t depth = 0;
+    for (const NodeBase* node = root(); node != nullptr; ++depth) {
+      visit();
+      last = node;
+      if constexpr (branchless_descent) {
+        bool right = less(key_of(node), key);
+        result = detail::select(right, result, node);
+        node = detail::select(right, node->right, node->left);
+      } else if (less(node, key, prefix)) {
+        node = node->right;
+      } else {
+        result = node;
+        node = node->left;
+      }
+    }
+    note_depth(depth, last);
+    return const_cast<NodeBase*>(result);
+  }
+
+  NodeBase* upper_bound_node(const Key& key) const {
+    const NodeBase* result = &sentinel;
+    KeyPrefixValue prefix = KeyPrefix::of(key);
+    const NodeBase* last = nullptr;
+    std::size_t depth = 0;
+    for (const NodeBase* node = root(); node != nullptr; ++depth) {
+      visit();
+      last = node;
+      if constexpr (branchless_descent) {
+        bool left = less(key, key_of(node));
+        result = detail::select(left, node, result);
+        node = detail::select(left, node->left, node->right);
+      } else if (less(key, prefix, node)) {
+        result = node;
+        node = node->left;
+      } else {
+        node = node->right;
+      }
+    }
+    note_depth(depth, last);
+    return const_cast<NodeBase*>(result);
+  }
+
+  static void pull(Node* node) noexcept {
+    if constexpr (augmented) {
+      cold_of(node).aug = Augmentation::combine(
+          Augmentation::combine(aug_of(node->left), Augmentation::lift(node->value)),
+          aug_of(node->right)
+      );
+    }
+  }
+
+  void pull_path(NodeBase* node) noexcept {
+    if constexpr (augmented) {
+      for (; node != &sentinel; node = parent_of(node)) {
+        pull(as_node(node));
+      }
+    }
+  }
+
+  // The depth guard: an insertion that visits more nodes than this rebuilds a subtree around the new node. A random
+  // treap of n nodes is about 3 log2(n) deep at worst, so only skewed priorities get past 4 log2(n). Lookups never
+  // change the shape of the tree: one that goes past the guard only notes the node it reached, and the next
+  // insertion or erasure repairs the path to it. Apart from that, whether lookups write anything is up to the
+  // instrumentation policy: `CountingInstrumentation` and `TimingInstrumentation` update counters on every lookup.
+  std::size_t depth_limit() const noexcept {
+    return 4 * static_cast<std::size_t>(std::bit_width(node_count));
+  }
+
+  // Leaves `last`, the node a lookup ended at after visiting `depth` nodes, for the next modification to repair if
+  // the lookup went past the depth guard. The store is atomic and only happens on a degenerate tree, so concurrent
+  // readers neither race nor contend for the cache line otherwise.
+  void note_depth(std::size_t depth, const NodeBase* last) const noexcept {
+    if (depth > depth_limit()) {
+      deep_node.store(const_cast<NodeBase*>(last), std::memory_order_relaxed);
+    }
+  }
+
+  // Rotations push down every node below the place where a new node stops, so a generator whose priorities are
+  // ordered, say increasing, can grow paths that no insertion walks and the insertion guard never sees. Lookups
+  // walk them, and this repairs what they found: it rebuilds the lowest ancestor of the noted node whose rebuild
+  // brings the node back within half the guard. The slack means a rebuilt subtree takes Omega(log n) further
+  // modifications to get past the guard again.
+  void repair_deep_path() noexcept {
+    NodeBase* node = deep_node.exchange(nullptr, std::memory_order_relaxed);
+    if (node == nullptr) {
+      return;
+    }
+    std::size_t depth = 1;
+    for (const NodeBase* ancestor = node; parent_of(ancestor) != &sentinel; ancestor = parent_of(ancestor)) {
+      ++depth;
+    }
+    if (depth <= depth_limit()) {
+      return;
+    }
+    // The root always qualifies: bit_width(n) is at most half the guard.
+    std::size_t target = depth_limit() / 2;
+    std::size_t size = subtree_size(node);
+    while (depth - 1 + static_cast<std::size_t>(std::bit_width(size)) > target) {
+      NodeBase* parent = parent_of(node);
+      size += 1 + subtree_size(parent->left == node ? parent->right : parent->left);
+      node = parent;
+      --depth;
+    }
+    // Thin ancestors, such as a chain of recent insertions whose priorities pushed the path down, cap the
+    // priorities of the rebuilt subtree and would keep doing so. They are taken in as well while that at most
+    // doubles the work.
+    for (std::size_t budget = 2 * size; parent_of(node) != &sentinel;) {
+      NodeBase* parent = parent_of(node);
+      std::size_t sibling_size = subtree_size(parent->left == node ? parent->right : parent->left);
+      if (size + 1 + sibling_size > budget) {
+        break;
+      }
+      size += 1 + sibling_size;
+      node = parent;
+    }
+    rebuild(node, size);
+  }
+
+  // Picks the subtree to rebuild after `leaf` went in past the depth guard, as a scapegoat tree does: the lowest
+  // ancestor that `leaf` hangs more than 4 log2(size) levels below. Such an ancestor has one child holding over
+  // 2^(-1/4) of its nodes, so after a rebuild it takes a number of insertions proportional to its size to get
+  // there again, and rebuilding costs O(log n) amortized per insertion. The root always qualifies when the guard
+  // trips. Returns the ancestor and its size; counting the siblings on the way up costs no more than the rebuild.
+  std::pair<NodeBase*, std::size_t> find_scapegoat(NodeBase* leaf) const noexcept {
+    NodeBase* node = leaf;
+    std::size_t size = 1;
+    for (std::size_t height = 1; parent_of(node) != &sentinel; ++height) {
+      NodeBase* parent = parent_of(node);
+      size += 1 + subtree_size(parent->left == node ? parent->right : parent->left);
+      node = parent;
+      if (static_cast<double>(height) > 4 * std::log2(static_cast<double>(size))) {
+        break;
+      }
+    }
+    return {node, size};
+  }
+
+  // Counts the nodes of the subtree under `node` by walking it in order through the parent links.
+  static std::size_t subtree_size(NodeBase* node) noexcept {
+    if (node == nullptr) {
+      return 0;
+    }
+    NodeBase* last = rightmost_of(node);
+    std::size_t result = 1;
+    for (NodeBase* it = leftmost_of(node); it != last; it = successor_of(it)) {
+      ++result;
+    }
+    return result;
+  }
+
+  // Relinks the `size` nodes of the subtree under `top` into a balanced one in O(size) time and O(log size) stack.
+  // Nodes are neither moved nor reallocated, so iterators stay valid; only the shape and the priorities change.
+  // The in-order sequence is kept, so the cached ends and the threads need no update.
+  void rebuild(NodeBase* top, std::size_t size) noexcept {
+    probe.record(TreapEvent::rebuild);
+    ++rebuild_count;
+    rebuilt_node_count += size;
+
+    NodeBase* parent = parent_of(top);
+    bool to_left = parent->left == top;
+
+    // Rotates the subtree into a vine: every node is the right child of its predecessor.
+    NodeBase head;
+    head.right = top;
+    NodeBase* tail = &head;
+    for (NodeBase* rest = tail->right; rest != nullptr;) {
+      if (rest->left == nullptr) {
+        tail = rest;
+        rest = rest->right;
+      } else {
+        NodeBase* left = rest->left;
+        rest->left = left->right;
+        left->right = rest;
+        rest = left;
+        tail->right = left;
+      }
+    }
+
+    // Priorities are capped at the parent's, so the heap order holds across the seam.
+    NodeBase* vine = head.right;
+    Priority cap = parent == &sentinel ? RandGen::max() : cold_of(parent).priority;
+    NodeBase* subtree = build_balanced(vine, size, cap).first;
+    if (parent == &sentinel) {
+      set_root(subtree);
+    } else {
+      (to_left ? parent->left : parent->right) = subtree;
+      parent_of(subtree) = parent;
+      pull_path(parent);
+    }
+  }
+
+  // Takes the first `count` nodes off `vine` and makes them a balanced subtree whose priorities do not exceed `cap`.
+  // Returns its root and height.
+  std::pair<NodeBase*, unsigned> build_balanced(NodeBase*& vine, std::size_t count, Priority cap) noexcept {
+    if (count == 0) {
+      return {nullptr, 0};
+    }
+    std::size_t left_count = (count - 1) / 2;
+    auto [left, left_height] = build_balanced(vine, left_count, cap);
+    Node* node = as_node(vine);
+    vine = vine->right;
+    auto [right, right_height] = build_balanced(vine, count - 1 - left_count, cap);
+
+    node->left = left;
+    node->right = right;
+    for (NodeBase* child : {left, right}) {
+      if (child != nullptr) {
+        parent_of(child) = node;
+      }
+    }
+    unsigned height = 1 + std::max(left_height, right_height);
+    cold_of(node).priority = std::min(priority_for_height(height), cap);
+    pull(node);
+    return {node, height};
+  }
+
+  // In a random treap the priority of a node with s nodes below it sits near the s/(s+1) quantile of the
+  // generator's range. A balanced subtree of height h has about 2^h nodes, which gives the priority below.
+  // Later insertions with properly random priorities then find the tree in the shape they would have built.
+  static Priority priority_for_height(unsigned height) noexcept {
+    constexpr Priority lo = RandGen::min();
+    constexpr Priority hi = RandGen::max();
+    if (height >= static_cast<unsigned>(std::numeric_limits<Priority>::digits)) {
+      return hi;
+    }
+    return static_cast<Priority>(hi - static_cast<Priority>(hi - lo) / (Priority{1} << height));
+  }
+
+  // Lifts `node` one level up, keeping the in-order sequence intact.
+  void rotate_up(Node* node) noexcept {
+    probe.record(TreapEvent::rotation);
+    Node* parent = as_node(parent_of(node));
+    NodeBase* grandparent = parent_of(parent);
+
+    if (parent->left == node) {
+      parent->left = node->right;
+      if (node->right != nullptr) {
+        parent_of(node->right) = parent;
+      }
+      node->right = parent;
+    } else {
+      parent->right = node->left;
+      if (node->left != nullptr) {
+        parent_of(node->left) = parent;
+      }
+      node->left = parent;
+    }
+
+    parent_of(parent) = node;
+    parent_of(node) = grandparent;
+    (grandparent->left == parent ? grandparent->left : grandparent->right) = node;
+
+    pull(parent);
+    pull(node);
+  }
+
+  // Copies the subtree of `src` in preorder, walking both trees along their parent links instead of recursing, so
+  // the stack stays flat however tall the tree is.
+  Node* copy_subtree(const NodeBase* src, NodeBase* parent) {
+    if (src == nullptr) {
+      return nullptr;
+    }
+
+    Node* result = clone_node(src);
+    parent_of(result) = parent;
+    try {
+      const NodeBase* from = src;
+      NodeBase* to = result;
+      for (;;) {
+        if (from->left != nullptr && to->left == nullptr) {
+          to->left = clone_node(from->left);
+          parent_of(to->left) = to;
+          from = from->left;
+          to = to->left;
+        } else if (from->right != nullptr && to->right == nullptr) {
+          to->right = clone_node(from->right);
+          parent_of(to->right) = to;
+          from = from->right;
+          to = to->right;
+        } else if (from != src) {
+          from = parent_of(from);
+          to = parent_of(to);
+        } else {
+          break;
+        }
+      }
+    } catch (...) {
+      destroy_subtree(result);
+      throw;
+    }
+    return result;
+  }
+
+  Node* clone_node(const NodeBase* src) {
+    Node* node = new_node(cold_of(src).priority, as_node(src)->value);
+    probe.record(TreapEvent::allocation);
+    cold_of(node).aug = cold_of(src).aug;
+    cold_of(node).multiplicity = cold_of(src).multiplicity;
+    return node;
+  }
+
+  template <typename... Args>
+  Node* new_node(Priority priority, Args&&... args) {
+    if constexpr (hot_cold) {
+      Node* slot = pool.allocate();
+      Node* node;
+      try {
+        node = new (slot) Node(std::forward<Args>(args)...);
+      } catch (...) {
+        pool.deallocate(slot);
+        throw;
+      }
+      new (Pool::cold_storage(node)) Cold{nullptr, priority};
+      set_prefix(node);
+      return node;
+    } else {
+      Node* node = new Node(priority, std::forward<Args>(args)...);
+      set_prefix(node);
+      return node;
+    }
+  }
+
+  static void set_prefix(Node* node) noexcept {
+    if constexpr (prefixed) {
+      node->prefix = KeyPrefix::of(Traits::key_of(node->value));
+    }
+  }
+
+  // Destroys leaves one by one, climbing back through the parent links, so no stack is needed.
+  void destroy_subtree(NodeBase* node) noexcept {
+    if (node == nullptr) {
+      return;
+    }
+    NodeBase* stop = parent_of(node);
+    while (node != stop) {
+      if (node->left != nullptr) {
+        node = node->left;
+      } else if (node->right != nullptr) {
+        node = node->right;
+      } else {
+        NodeBase* parent = parent_of(node);
+        if (parent != stop) {
+          (parent->left == node ? parent->left : parent->right) = nullptr;
+        }
+        destroy_node(as_node(node));
+        node = parent;
+      }
+    }
+  }
+
+private:
+  // A block of nodes allocated by `compact`. It is freed once none of its `live` nodes are left.
+  struct Slab {
+    Node* nodes;
+    std::size_t capacity;
+    std::size_t live;
+  };
+
+  // Destroys `node` and releases its memory. Only compacted nodes live in slabs, and there are few of those, so the
+  // other nodes pay for no more than the emptiness check.
+  void free_node(Node* node) noexcept {
+    if constexpr (hot_cold) {
+      cold_of(node).~Cold();
+      node->~Node();
+      pool.deallocate(node);
+      return;
+    }
+    if (!slabs.empty()) {
+      auto after = std::upper_bound(slabs.begin(), slabs.end(), node, [](const Node* node, const Slab& slab) {
+        return std::less<>()(node, slab.nodes);
+      });
+      if (after != slabs.begin() && std::less<>()(node, std::prev(after)->nodes + std::prev(after)->capacity)) {
+        auto slab = std::prev(after);
+        node->~Node();
+        if (--slab->live == 0) {
+          std::allocator<Node>().deallocate(slab->nodes, slab->capacity);
+          slabs.erase(slab);
+        }
+        return;
+      }
+    }
+    delete node;
+  }
+
+  // Destroys every node without opening an operation, so the deallocations count towards the caller's.
+  void release_nodes() noexcept {
+    destroy_subtree(root());
+    sentinel.left = nullptr;
+    sentinel.leftmost = nullptr;
+    sentinel.rightmost = nullptr;
+    element_count = 0;
+    node_count = 0;
+    compact_cursor = nullptr;
+    deep_node.store(nullptr, std::memory_order_relaxed);
+    if constexpr (hot_cold) {
+      pool.release();
+    }
+    if constexpr (filtered) {
+      bloom.clear();
+    }
+  }
+
+  // Moves `nodes` into a new slab in the given order, redirects every link to them and frees their old storage.
+  // Returns the first node of the slab. Only the allocations can throw, and they come first.
+  Node* relocate(const std::vector<Node*>& nodes) {
+    slabs.reserve(slabs.size() + 1);
+    // The noted node may move; a later lookup notes it again if its path is still too long.
+    deep_node.store(nullptr, std::memory_order_relaxed);
+    Slab slab{std::allocator<Node>().allocate(nodes.size()), nodes.size(), nodes.size()};
+    slabs.insert(
+        std::upper_bound(
+            slabs.begin(),
+            slabs.end(),
+            slab.nodes,
+            [](const Node* nodes, const Slab& other) { return std::less<>()(nodes, other.nodes); }
+        ),
+        slab
+    );
+
+    Node* to = slab.nodes;
+    for (Node* from : nodes) {
+      move_node(from, to++);
+    }
+    return slab.nodes;
+  }
+
+  void move_node(Node* from, Node* to) noexcept {
+    Node* node = new (to) Node(from->priority, std::move(from->value));
+    node->prefix = from->prefix;
+    node->left = from->left;
+    node->right = from->right;
+    node->parent = from->parent;
+    node->aug = from->aug;
+    node->multiplicity = from->multiplicity;
+    node->threads = from->threads;
+
+    (node->parent->left == from ? node->parent->left : node->parent->right) = node;
+    for (NodeBase* child : {node->left, node->right}) {
+      if (child != nullptr) {
+        child->parent = node;
+      }
+    }
+    if constexpr (threaded) {
+      if (node->threads.prev != &sentinel) {
+        as_node(node->threads.prev)->threads.next = node;
+      }
+      if (node->threads.next != &sentinel) {
+        as_node(node->threads.next)->threads.prev = node;
+      }
+    }
+    for (NodeBase** end : {&sentinel.leftmost, &sentinel.rightmost, &compact_cursor}) {
+      if (*end == from) {
+        *end = node;
+      }
+    }
+    free_node(from);
+  }
+
+  // Appends the nodes of the top `levels` levels below `node` in van Emde Boas order: the top half of these levels
+  // laid out the same way, then every subtree hanging below them from left to right. The recursion halves `levels`
+  // on every call, so its depth stays logarithmic even in a degenerate tree.
+  static void van_emde_boas_order(NodeBase* node, std::size_t levels, std::vector<Node*>& out) {
+    if (levels == 1) {
+      out.push_back(as_node(node));
+      return;
+    }
+    std::size_t top = levels / 2;
+    van_emde_boas_order(node, top, out);
+
+    std::vector<NodeBase*> bottom;
+    std::vector<std::pair<NodeBase*, std::size_t>> pending{{node, 0}};
+    while (!pending.empty()) {
+      auto [next, depth] = pending.back();
+      pending.pop_back();
+      if (depth == top) {
+        bottom.push_back(next);
+        continue;
+      }
+      for (NodeBase* child : {next->right, next->left}) {
+        if (child != nullptr) {
+          pending.emplace_back(child, depth + 1);
+        }
+      }
+    }
+    for (NodeBase* subtree : bottom) {
+      van_emde_boas_order(subtree, levels - top, out);
+    }
+  }
+
+private:
+  Header sentinel;
+  std::size_t element_count = 0;
+  std::size_t node_count = 0;
+  std::size_t rebuild_count = 0;
+  std::size_t rebuilt_node_count = 0;
+  // Sorted by address.
+  std::vector<Slab> slabs;
+  // Where the next `compact_step` continues, or null to start from the minimum.
+  NodeBase* compact_cursor = nullptr;
+  // Where a lookup last went past the depth guard, or null. See `repair_deep_path`.
+  mutable std::atomic<NodeBase*> deep_node = nullptr;
+  [[no_unique_address]] Pool pool;
+  [[no_unique_address]] Filter bloom;
+  [[no_unique_address]] mutable Instrumentation probe;
+};
+
+template <
+    typename Traits,
+    std::uniform_random_bit_generator RandGen,
+    typename Augmentation,
+    typename Instrumentation,
+    typename Layout,
+    typename KeyPrefix,
+    typename Filter>
+template <bool is_const>
+class TreapEngine<Traits, RandGen, Augmentation, Instrumentation, Layout, KeyPrefix, Filter>::BasicIterator {
+public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = std::remove_const_t<Value>;
+  using difference_type = std::ptrdiff_t;
+  using pointer = std::conditional_t<is_const, const Value*, Value*>;
+  using reference = std::conditional_t<is_const, const Value&, Value&>;
+
+public:
+  BasicIterator() noexcept = default;
+
+  template <bool other_const>
+    requires (is_const && !other_const)
+  BasicIterator(const BasicIterator<other_const>& other) noexcept
+      : node(other.node) {}
+
+  reference operator*() const noexcept {
+    return as_node(node)->value;
+  }
+
+  pointer operator->() const noexcept {
+    return &as_node(node)->value;
+  }
+
+  BasicIterator& operator++() noexcept {
+    if constexpr (threaded) {
+      step(as_node(node)->threads.next);
+    } else if (node->right != nullptr) {
+      step(node->right);
+      while (node->left != nullptr) {
+        step(node->left);
+      }
+    } else {
+      while (parent_of(node)->right == node) {
+        step(parent_of(node));
+      }
+      step(parent_of(node));
+    }
+    return *this;
+  }
+
+  BasicIterator operator++(int) noexcept {
+    BasicIterator result = *this;
+    ++*this;
+    return result;
+  }
+
+  BasicIterator& operator--() noexcept {
+    if (is_header(node)) {
+      step(static_cast<Header*>(node)->rightmost);
+    } else if constexpr (threaded) {
+      step(as_node(node)->threads.prev);
+    } else if (node->left != nullptr) {
+      step(node->left);
+      while (node->right != nullptr) {
+        step(node->right);
+      }
+    } else {
+      while (parent_of(node)->left == node) {
+        step(parent_of(node));
+      }
+      step(parent_of(node));
+    }
+    return *this;
+  }
+
+  BasicIterator operator--(int) noexcept {
+    BasicIterator result = *this;
+    --*this;
+    return result;
+  }
+
+  friend bool operator==(const BasicIterator& lhs, const BasicIterator& rhs) noexcept = default;
+
+private:
+  explicit BasicIterator(const NodeBase* node) noexcept
+      : node(const_cast<NodeBase*>(node)) {}
+
+  // Iterators do not know their container, so only a policy with static members can be told about their steps.
+  void step(NodeBase* next) noexcept {
+    if constexpr (requires { Instrumentation::record(TreapEvent::node_visit); }) {
+      Instrumentation::record(TreapEvent::node_visit);
+    }
+    node = next;
+  }
+
+  friend TreapEngine;
+
+  template <bool>
+  friend class BasicIterator;
+
+private:
+  NodeBase* node = nullptr;
+};
+
+} // namespace detail
+
+template <
+    typename T,
+    std::uniform_random_bit_generator RandGen = std::mt19937,
+    TreapAugmentation<T> Augmentation = NoAugmentation,
+    TreapInstrumentation Instrumentation = NoInstrumentation,
+    TreapLayout Layout = PlainLayout,
+    TreapKeyPrefix<T> KeyPrefix = NoKeyPrefix,
+    TreapFilter Filter = NoFilter>
+class Treap : public detail::TreapEngine<
+                  detail::SetTraits<T>,
+                  RandGen,
+                  Augmentation,
+                  Instrumentation,
+                  Layout,
+                  KeyPrefix,
+                  Filter> {
+  static_assert(!std::is_const_v<T>, "T must be non-const");
+  static_assert(std::is_nothrow_move_constructible_v<T>, "T must have a non-throwing move constructor");
+
+  using Base =
+      detail::TreapEngine<detail::SetTraits<T>, RandGen, Augmentation, Instrumentation, Layout, KeyPrefix, Filter>;
+
+public:
+  using ValueType = T;
+
+  using Reference = T&;
+  using ConstReference = const T&;
+
+  using Pointer = T*;
+  using ConstPointer = const T*;
+
+  using AugmentationType = Augmentation;
+
+  using typename Base::ConstIterator;
+  using typename Base::ConstReverseIterator;
+  using typename Base::Iterator;
+  using typename Base::ReverseIterator;
+
+public:
+  using Base::Base;
 
-  ConstIterator begin() const noexcept;
+  std::pair<Iterator, bool> insert(const T& value)
+    requires (std::is_copy_constructible_v<T>)
+  {
+    return insert_impl(value);
+  }
 
-  ConstIterator end() const noexcept;
+  // Moves `value` into a new node exactly once, and leaves it untouched if an equal element is already present.
+  std::pair<Iterator, bool> insert(T&& value) {
+    return insert_impl(std::move(value));
+  }
 
-  ConstReverseIterator rbegin() const noexcept;
+  // Constructs the element from `args` right inside a new node. The node is made before the search, so the
+  // arguments are consumed even when an equal element turns out to be present.
+  template <typename... Args>
+  std::pair<Iterator, bool> emplace(Args&&... args) {
+    auto scope = this->measure(TreapOperation::insert);
+    auto* node = this->create_node(std::forward<Args>(args)...);
+    typename Base::Slot slot{};
+    try {
+      slot = this->find_slot(node->value);
+    } catch (...) {
+      this->destroy_node(node);
+      throw;
+    }
+    if (slot.found != nullptr) {
+      this->destroy_node(node);
+      return {Base::iterator_to(slot.found), false};
+    }
+    this->link(slot, node);
+    return {Base::iterator_to(node), true};
+  }
 
-  ConstReverseIterator rend() const noexcept;
+  using Base::erase;
 
-  std::pair<Iterator, bool> insert(const T& value);
+  std::size_t erase(const T& value) {
+    auto scope = this->measure(TreapOperation::erase);
+    auto* node = this->find_node(value);
+    if (node == this->header()) {
+      return 0;
+    }
+    this->erase_node(Base::as_node(node));
+    return 1;
+  }
 
-  std::pair<Iterator, bool> insert(T&& value);
+  // Removes the element at `pos` and returns it, moved out of its node.
+  T extract(ConstIterator pos) noexcept {
+    auto scope = this->measure(TreapOperation::erase);
+    return take(Base::node_of(pos));
+  }
 
-  Iterator erase(ConstIterator pos) noexcept;
+  // Removes the element equal to `value` and returns it, or nothing if there is none.
+  std::optional<T> extract(const T& value) {
+    auto scope = this->measure(TreapOperation::erase);
+    auto* node = this->find_node(value);
+    if (node == this->header()) {
+      return std::nullopt;
+    }
+    return take(node);
+  }
 
-  std::size_t erase(const T& value);
+  // Removes the smallest element; the container must not be empty. The minimum has no left child, so it is
+  // unlinked without rotations, and finding the next minimum takes expected O(1) steps.
+  void pop_front() noexcept {
+    auto scope = this->measure(TreapOperation::erase);
+    this->erase_node(Base::as_node(Base::node_of(this->begin())));
+  }
 
-  ConstIterator lower_bound(const T& value) const;
+  // Removes the largest element; the container must not be empty.
+  void pop_back() noexcept {
+    auto scope = this->measure(TreapOperation::erase);
+    this->erase_node(Base::as_node(Base::node_of(std::prev(this->end()))));
+  }
 
-  ConstIterator upper_bound(const T& value) const;
+  // Removes the smallest element and returns it; the container must not be empty.
+  T extract_front() noexcept {
+    auto scope = this->measure(TreapOperation::erase);
+    return take(Base::node_of(this->begin()));
+  }
 
-  ConstIterator find(const T& value) const;
+private:
+  T take(typename Base::NodeBase* pos) noexcept {
+    auto* node = this->unlink_node(Base::as_node(pos));
+    T result(std::move(node->value));
+    this->destroy_node(node);
+    return result;
+  }
 
-  friend void swap(Treap& lhs, Treap& rhs) noexcept;
+  template <typename U>
+  std::pair<Iterator, bool> insert_impl(U&& value) {
+    auto scope = this->measure(TreapOperation::insert);
+    typename Base::Slot slot = this->find_slot(value);
+    if (slot.found != nullptr) {
+      return {Base::iterator_to(slot.found), false};
+    }
+    auto* node = this->create_node(std::forward<U>(value));
+    this->link(slot, node);
+    return {Base::iterator_to(node), true};
+  }
 };
 
 } // namespace ct
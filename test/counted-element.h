@@ -0,0 +1,64 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace ct_test {
+
+// An integer that counts how many times any instance was copied and moved, so tests can check that a container
+// never copies elements behind the scenes.
+struct CountedElement {
+  CountedElement(int data) noexcept
+      : data(data) {}
+
+  CountedElement(const CountedElement& other) noexcept
+      : data(other.data) {
+    ++copies;
+  }
+
+  CountedElement(CountedElement&& other) noexcept
+      : data(std::exchange(other.data, -1)) {
+    ++moves;
+  }
+
+  CountedElement& operator=(const CountedElement& other) noexcept {
+    data = other.data;
+    ++copies;
+    return *this;
+  }
+
+  CountedElement& operator=(CountedElement&& other) noexcept {
+    data = std::exchange(other.data, -1);
+    ++moves;
+    return *this;
+  }
+
+  static void reset_counts() noexcept {
+    copies = 0;
+    moves = 0;
+  }
+
+  friend bool operator==(const CountedElement&, const CountedElement&) = default;
+  friend auto operator<=>(const CountedElement&, const CountedElement&) = default;
+
+  int data;
+
+  static inline std::size_t copies = 0;
+  static inline std::size_t moves = 0;
+};
+
+// A move-only handle ordered by the value it owns.
+struct MoveOnlyElement {
+  explicit MoveOnlyElement(int data)
+      : data(std::make_unique<int>(data)) {}
+
+  friend bool operator<(const MoveOnlyElement& a, const MoveOnlyElement& b) noexcept {
+    return *a.data < *b.data;
+  }
+
+  std::unique_ptr<int> data;
+};
+
+} // namespace ct_test
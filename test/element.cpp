@@ -57,6 +57,7 @@ bool operator==(const Element& a, const Element& b) {
   a.assert_exists();
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data == b.data;
 }
 
@@ -64,6 +65,7 @@ bool operator!=(const Element& a, const Element& b) {
   a.assert_exists();
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data != b.data;
 }
 
@@ -71,6 +73,7 @@ bool operator<(const Element& a, const Element& b) {
   a.assert_exists();
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data < b.data;
 }
 
@@ -78,6 +81,7 @@ bool operator<=(const Element& a, const Element& b) {
   a.assert_exists();
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data <= b.data;
 }
 
@@ -85,6 +89,7 @@ bool operator>(const Element& a, const Element& b) {
   a.assert_exists();
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data > b.data;
 }
 
@@ -92,78 +97,91 @@ bool operator>=(const Element& a, const Element& b) {
   a.assert_exists();
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data >= b.data;
 }
 
 bool operator==(const Element& a, int b) {
   a.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data == b;
 }
 
 bool operator!=(const Element& a, int b) {
   a.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data != b;
 }
 
 bool operator<(const Element& a, int b) {
   a.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data < b;
 }
 
 bool operator<=(const Element& a, int b) {
   a.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data <= b;
 }
 
 bool operator>(const Element& a, int b) {
   a.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data > b;
 }
 
 bool operator>=(const Element& a, int b) {
   a.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a.data >= b;
 }
 
 bool operator==(int a, const Element& b) {
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a == b.data;
 }
 
 bool operator!=(int a, const Element& b) {
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a != b.data;
 }
 
 bool operator<(int a, const Element& b) {
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a < b.data;
 }
 
 bool operator<=(int a, const Element& b) {
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a <= b.data;
 }
 
 bool operator>(int a, const Element& b) {
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a > b.data;
 }
 
 bool operator>=(int a, const Element& b) {
   b.assert_exists();
   fault_injection_point();
+  ++Element::comparison_count;
   return a >= b.data;
 }
 
@@ -196,7 +214,12 @@ void ct_test::Element::assert_exists() const {
   }
 }
 
+std::size_t ct_test::Element::comparisons() {
+  return comparison_count;
+}
+
 std::set<const ct_test::Element*> ct_test::Element::instances;
+std::size_t ct_test::Element::comparison_count = 0;
 
 ct_test::Element::NoNewInstancesGuard::NoNewInstancesGuard()
     : old_instances(instances) {}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <set>
 
 namespace ct_test {
@@ -17,6 +18,9 @@ struct Element {
   Element& operator=(Element&& c) noexcept;
   operator int() const;
 
+  // Calls of the comparison operators below since the program started.
+  static std::size_t comparisons();
+
   friend bool operator==(const Element& a, const Element& b);
   friend bool operator!=(const Element& a, const Element& b);
   friend bool operator<(const Element& a, const Element& b);
@@ -47,6 +51,7 @@ private:
   int data;
 
   static std::set<const Element*> instances;
+  static std::size_t comparison_count;
 };
 
 struct Element::NoNewInstancesGuard {
@@ -0,0 +1,214 @@
+#include "implicit-treap.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace ct_test {
+
+namespace {
+
+template <typename T>
+void expect_sequence(const ct::ImplicitTreap<T>& c, const std::vector<T>& expected) {
+  REQUIRE(c.size() == expected.size());
+  REQUIRE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+}
+
+// Gives every node the same priority, so appending builds a single left path as tall as the sequence.
+struct ConstantRng {
+  using result_type = unsigned;
+
+  static constexpr result_type min() noexcept {
+    return 0;
+  }
+
+  static constexpr result_type max() noexcept {
+    return ~0u;
+  }
+
+  result_type operator()() noexcept {
+    return 0;
+  }
+};
+
+} // namespace
+
+TEST_CASE("Implicit treap insert and erase by position") {
+  ct::ImplicitTreap<int> c;
+  c.push_back(1);
+  c.push_back(3);
+  c.insert_at(1, 2);
+  c.insert_at(0, 0);
+  expect_sequence(c, {0, 1, 2, 3});
+
+  c.erase_at(2);
+  expect_sequence(c, {0, 1, 3});
+  REQUIRE(c[2] == 3);
+
+  c[0] = 42;
+  expect_sequence(c, {42, 1, 3});
+}
+
+TEST_CASE("Implicit treap split and concat") {
+  ct::ImplicitTreap<int> c;
+  for (int i = 0; i < 10; ++i) {
+    c.push_back(i);
+  }
+
+  ct::ImplicitTreap<int> tail = c.split_at(6);
+  expect_sequence(c, {0, 1, 2, 3, 4, 5});
+  expect_sequence(tail, {6, 7, 8, 9});
+
+  tail.concat(std::move(c));
+  expect_sequence(tail, {6, 7, 8, 9, 0, 1, 2, 3, 4, 5});
+  REQUIRE(c.empty());
+}
+
+TEST_CASE("Implicit treap lazy range operations") {
+  ct::ImplicitTreap<int> c;
+  for (int i = 0; i < 8; ++i) {
+    c.push_back(i);
+  }
+
+  c.reverse(2, 6);
+  expect_sequence(c, {0, 1, 5, 4, 3, 2, 6, 7});
+
+  c.add(1, 4, 10);
+  expect_sequence(c, {0, 11, 15, 14, 3, 2, 6, 7});
+
+  ct::ImplicitTreap<int> copy = c;
+  c.reverse(0, 8);
+  expect_sequence(c, {7, 6, 2, 3, 14, 15, 11, 0});
+  expect_sequence(copy, {0, 11, 15, 14, 3, 2, 6, 7});
+}
+
+TEST_CASE("Implicit treap treats inverted ranges as empty") {
+  ct::ImplicitTreap<int> c;
+  for (int i = 0; i < 8; ++i) {
+    c.push_back(i);
+  }
+
+  c.reverse(5, 2);
+  c.add(3, 1, 10);
+  c.add(4, 4, 10);
+  expect_sequence(c, {0, 1, 2, 3, 4, 5, 6, 7});
+
+  c.reverse(5, 20);
+  expect_sequence(c, {0, 1, 2, 3, 4, 7, 6, 5});
+}
+
+TEST_CASE("Implicit treap const access sees pending tags") {
+  static_assert(std::forward_iterator<ct::ImplicitTreap<int>::ConstIterator>);
+
+  ct::ImplicitTreap<int> c;
+  for (int i = 0; i < 100; ++i) {
+    c.push_back(i);
+  }
+  c.add(0, 100, 1);
+  c.reverse(10, 90);
+  c.add(40, 60, 1'000);
+  c.reverse(0, 50);
+
+  std::vector<int> expected(100);
+  std::iota(expected.begin(), expected.end(), 1);
+  std::reverse(expected.begin() + 10, expected.begin() + 90);
+  std::for_each(expected.begin() + 40, expected.begin() + 60, [](int& e) { e += 1'000; });
+  std::reverse(expected.begin(), expected.begin() + 50);
+
+  const ct::ImplicitTreap<int>& view = c;
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    REQUIRE(view[i] == expected[i]);
+  }
+  expect_sequence(c, expected);
+}
+
+TEST_CASE("Implicit treap of non-addable elements") {
+  ct::ImplicitTreap<std::string> c;
+  c.push_back("b");
+  c.insert_at(0, "a");
+  c.push_back("c");
+  c.reverse(0, 3);
+  expect_sequence(c, {"c", "b", "a"});
+}
+
+TEST_CASE("Implicit treap handles a path as tall as the sequence") {
+  constexpr int n = 300'000;
+  ct::ImplicitTreap<int, ConstantRng> c;
+  for (int i = 0; i < n; ++i) {
+    c.push_back(i);
+  }
+
+  ct::ImplicitTreap<int, ConstantRng> copy = c;
+  copy.reverse(0, n);
+  copy.add(n / 2, n, 1);
+  REQUIRE(copy[0] == n - 1);
+  REQUIRE(copy[n / 2 - 1] == n / 2);
+  REQUIRE(copy[n - 1] == 1);
+
+  ct::ImplicitTreap<int, ConstantRng> tail = c.split_at(n / 3);
+  REQUIRE(c.size() == n / 3);
+  REQUIRE(tail.size() == n - n / 3);
+  REQUIRE(tail[0] == n / 3);
+  tail.concat(std::move(c));
+  REQUIRE(tail[n - 1] == n / 3 - 1);
+}
+
+TEST_CASE("Random implicit treap operations") {
+  std::mt19937 rng(1345);
+
+  std::vector<long long> expected;
+  ct::ImplicitTreap<long long> c;
+
+  for (size_t i = 0; i < 20'000; ++i) {
+    std::size_t l = rng() % (expected.size() + 1);
+    std::size_t r = l + rng() % (expected.size() - l + 1);
+
+    switch (rng() % 6) {
+    case 0:
+    case 1: {
+      long long value = rng() % 1'000;
+      expected.insert(expected.begin() + l, value);
+      c.insert_at(l, value);
+      break;
+    }
+    case 2:
+      if (l < expected.size()) {
+        expected.erase(expected.begin() + l);
+        c.erase_at(l);
+      }
+      break;
+    case 3:
+      std::reverse(expected.begin() + l, expected.begin() + r);
+      c.reverse(l, r);
+      break;
+    case 4:
+      std::for_each(expected.begin() + l, expected.begin() + r, [](long long& e) { e += 7; });
+      c.add(l, r, 7);
+      break;
+    default: {
+      ct::ImplicitTreap<long long> tail = c.split_at(l);
+      tail.concat(std::move(c));
+      c = std::move(tail);
+      std::rotate(expected.begin(), expected.begin() + l, expected.end());
+      break;
+    }
+    }
+
+    if (l < expected.size()) {
+      const ct::ImplicitTreap<long long>& view = c;
+      REQUIRE(view[l] == expected[l]);
+      REQUIRE(c[l] == expected[l]);
+    }
+    if (i % 1'000 == 0) {
+      expect_sequence(c, expected);
+    }
+  }
+  expect_sequence(c, expected);
+}
+
+} // namespace ct_test
@@ -0,0 +1,87 @@
+#include "interval-treap.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace ct_test {
+
+namespace {
+
+using IntervalContainer = ct::IntervalTreap<int>;
+using Interval = IntervalContainer::IntervalType;
+
+std::vector<Interval> collect(const IntervalContainer::OverlapRange& range) {
+  return {range.begin(), range.end()};
+}
+
+} // namespace
+
+TEST_CASE("Stabbing query") {
+  IntervalContainer c;
+  c.insert({1, 5});
+  c.insert({2, 3});
+  c.insert({4, 10});
+  c.insert({6, 7});
+  c.insert({11, 12});
+
+  REQUIRE(collect(c.stabbing(0)).empty());
+  REQUIRE(collect(c.stabbing(3)) == std::vector<Interval>{{1, 5}, {2, 3}});
+  REQUIRE(collect(c.stabbing(5)) == std::vector<Interval>{{1, 5}, {4, 10}});
+  REQUIRE(collect(c.stabbing(7)) == std::vector<Interval>{{4, 10}, {6, 7}});
+  REQUIRE(collect(c.stabbing(13)).empty());
+}
+
+TEST_CASE("Overlap query") {
+  IntervalContainer c;
+  c.insert({1, 2});
+  c.insert({3, 4});
+  c.insert({5, 6});
+  c.insert({0, 100});
+
+  REQUIRE(collect(c.overlapping(2, 3)) == std::vector<Interval>{{0, 100}, {1, 2}, {3, 4}});
+  REQUIRE(collect(c.overlapping(7, 8)) == std::vector<Interval>{{0, 100}});
+
+  c.erase({0, 100});
+  REQUIRE(collect(c.overlapping(7, 8)).empty());
+  REQUIRE(collect(c.overlapping(-5, 1)) == std::vector<Interval>{{1, 2}});
+}
+
+TEST_CASE("Overlap query in empty") {
+  IntervalContainer c;
+  REQUIRE(c.stabbing(0).empty());
+  REQUIRE(c.overlapping(-10, 10).begin() == c.overlapping(-10, 10).end());
+}
+
+TEST_CASE("Random overlap queries") {
+  std::mt19937 rng(1344);
+  std::uniform_int_distribution<int> point_dist(0, 1'000);
+  std::uniform_int_distribution<int> length_dist(0, 50);
+
+  std::set<Interval> std_set;
+  IntervalContainer c;
+
+  for (size_t i = 0; i < 5'000; ++i) {
+    int lo = point_dist(rng);
+    Interval interval{lo, lo + length_dist(rng)};
+    if (rng() % 4 == 0) {
+      REQUIRE(c.erase(interval) == std_set.erase(interval));
+    } else {
+      REQUIRE(c.insert(interval).second == std_set.insert(interval).second);
+    }
+
+    int qlo = point_dist(rng);
+    int qhi = qlo + length_dist(rng);
+    std::vector<Interval> expected;
+    std::copy_if(std_set.begin(), std_set.end(), std::back_inserter(expected), [&](const Interval& e) {
+      return e.lo <= qhi && qlo <= e.hi;
+    });
+    REQUIRE(collect(c.overlapping(qlo, qhi)) == expected);
+  }
+}
+
+} // namespace ct_test
@@ -0,0 +1,134 @@
+#include "latency-histogram.h"
+#include "treap-instrumentation.h"
+#include "treap.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <string>
+
+namespace ct_test {
+
+namespace {
+
+// Advances by 10 units on every read, so every outermost operation takes exactly 10.
+struct FakeClock {
+  static constexpr std::string_view unit = "ticks";
+
+  static std::uint64_t now() noexcept {
+    return ticks += 10;
+  }
+
+  static inline std::uint64_t ticks = 0;
+};
+
+} // namespace
+
+TEST_CASE("Latency histogram percentiles") {
+  ct::LatencyHistogram h;
+  REQUIRE(h.count() == 0);
+  REQUIRE(h.percentile(0.5) == 0);
+
+  for (std::uint64_t v = 1; v <= 100'000; ++v) {
+    h.record(v);
+  }
+  REQUIRE(h.count() == 100'000);
+  REQUIRE(h.min() == 1);
+  REQUIRE(h.max() == 100'000);
+  REQUIRE(h.mean() == Catch::Approx(50'000.5));
+  for (double p : {0.5, 0.9, 0.99, 0.999}) {
+    auto expected = static_cast<double>(p * 100'000);
+    REQUIRE(static_cast<double>(h.percentile(p)) >= expected);
+    REQUIRE(static_cast<double>(h.percentile(p)) <= expected * (1 + 1.0 / 32));
+  }
+  REQUIRE(h.percentile(1.0) == 100'000);
+}
+
+TEST_CASE("Latency histogram keeps small values exact") {
+  ct::LatencyHistogram h;
+  for (std::uint64_t v : {0, 3, 3, 7, 31, 63}) {
+    h.record(v);
+  }
+  REQUIRE(h.percentile(0.01) == 0);
+  REQUIRE(h.percentile(0.5) == 3);
+  REQUIRE(h.percentile(0.6) == 7);
+  REQUIRE(h.percentile(1.0) == 63);
+
+  h.record(UINT64_MAX);
+  REQUIRE(h.max() == UINT64_MAX);
+  REQUIRE(h.percentile(1.0) == UINT64_MAX);
+}
+
+TEST_CASE("Latency histograms merge") {
+  std::mt19937_64 gen(1349);
+  ct::LatencyHistogram a;
+  ct::LatencyHistogram b;
+  ct::LatencyHistogram both;
+  for (int i = 0; i < 10'000; ++i) {
+    std::uint64_t v = gen() % 1'000'000;
+    (i % 3 == 0 ? a : b).record(v);
+    both.record(v);
+  }
+
+  a.merge(b);
+  REQUIRE(a.count() == both.count());
+  REQUIRE(a.min() == both.min());
+  REQUIRE(a.max() == both.max());
+  for (double p : {0.5, 0.99, 0.999}) {
+    REQUIRE(a.percentile(p) == both.percentile(p));
+  }
+
+  a.reset();
+  REQUIRE(a.count() == 0);
+  REQUIRE(a.max() == 0);
+}
+
+TEST_CASE("Latency histogram dumps") {
+  ct::LatencyHistogram h;
+  h.record(5);
+  h.record(1'000);
+
+  std::ostringstream text;
+  h.write_text(text);
+  REQUIRE(text.str() == "count=2 min=5ns mean=502.5ns p50=5ns p90=1000ns p99=1000ns p99.9=1000ns max=1000ns");
+
+  std::ostringstream json;
+  h.write_json(json, "cycles");
+  REQUIRE(json.str().starts_with("{\"unit\":\"cycles\",\"count\":2,\"min\":5,"));
+  REQUIRE(json.str().ends_with(",\"buckets\":[[5,1],[992,1]]}"));
+}
+
+TEST_CASE("Timing instrumentation records outermost operations") {
+  ct::Treap<int, std::mt19937, ct::NoAugmentation, ct::TimingInstrumentation<FakeClock>> c;
+  for (int i = 0; i < 100; ++i) {
+    c.insert(i);
+  }
+  c.find(5);
+  c.erase(5);
+  c.clear();
+
+  const auto& timing = c.instrumentation();
+  REQUIRE(timing.histogram(ct::TreapOperation::insert).count() == 100);
+  REQUIRE(timing.histogram(ct::TreapOperation::insert).max() == 10);
+  REQUIRE(timing.histogram(ct::TreapOperation::find).count() == 1);
+  REQUIRE(timing.histogram(ct::TreapOperation::erase).count() == 1);
+  REQUIRE(timing.histogram(ct::TreapOperation::clear).count() == 1);
+  REQUIRE(timing.histogram(ct::TreapOperation::lower_bound).count() == 0);
+
+  ct::TimingInstrumentation<FakeClock> merged;
+  merged.merge(timing);
+  merged.merge(timing);
+  REQUIRE(merged.histogram(ct::TreapOperation::insert).count() == 200);
+
+  std::ostringstream text;
+  timing.write_text(text);
+  REQUIRE(text.str().starts_with("insert count=100 min=10ticks"));
+
+  std::ostringstream json;
+  timing.write_json(json);
+  REQUIRE(json.str().starts_with("{\"insert\":{\"unit\":\"ticks\",\"count\":100,"));
+}
+
+} // namespace ct_test
@@ -0,0 +1,108 @@
+#include "mapped-treap.h"
+#include "treap.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#include <unistd.h>
+
+namespace ct_test {
+
+namespace {
+
+class TempFile {
+public:
+  TempFile()
+      : path(
+            std::filesystem::temp_directory_path() /
+            ("ct-mapped-" + std::to_string(::getpid()) + "-" + std::to_string(counter++))
+        ) {}
+
+  TempFile(const TempFile&) = delete;
+  TempFile& operator=(const TempFile&) = delete;
+
+  ~TempFile() {
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+  }
+
+  std::string str() const {
+    return path.string();
+  }
+
+private:
+  static inline int counter = 0;
+  std::filesystem::path path;
+};
+
+template <typename C>
+void save_to(const C& c, const TempFile& file) {
+  std::ofstream out(file.str(), std::ios::binary);
+  c.save(out);
+}
+
+} // namespace
+
+TEST_CASE("Mapped treap queries") {
+  ct::Treap<int> c;
+  for (int i = 0; i < 1'000; ++i) {
+    c.insert(i * 3);
+  }
+  TempFile file;
+  save_to(c, file);
+
+  ct::MappedTreap<int> mapped(file.str());
+  REQUIRE(mapped.size() == c.size());
+  REQUIRE(mapped.verify());
+  REQUIRE(std::equal(mapped.begin(), mapped.end(), c.begin(), c.end()));
+
+  REQUIRE(*mapped.find(300) == 300);
+  REQUIRE(mapped.find(301) == mapped.end());
+  REQUIRE(*mapped.lower_bound(301) == 303);
+  REQUIRE(*mapped.upper_bound(303) == 306);
+  REQUIRE(mapped.lower_bound(3'000) == mapped.end());
+  REQUIRE(mapped.contains(0));
+
+  ct::MappedTreap<int> second(file.str());
+  REQUIRE(second.size() == mapped.size());
+
+  ct::MappedTreap<int> moved = std::move(mapped);
+  REQUIRE(moved.contains(2'997));
+  REQUIRE(mapped.empty());
+}
+
+TEST_CASE("Mapped treap of empty snapshot") {
+  ct::Treap<long long> c;
+  TempFile file;
+  save_to(c, file);
+
+  ct::MappedTreap<long long> mapped(file.str());
+  REQUIRE(mapped.empty());
+  REQUIRE(mapped.begin() == mapped.end());
+  REQUIRE(mapped.find(1) == mapped.end());
+}
+
+TEST_CASE("Mapped treap rejects mismatched files") {
+  ct::Treap<int> c;
+  c.insert(1);
+  TempFile file;
+  save_to(c, file);
+
+  REQUIRE_THROWS_AS(ct::MappedTreap<long long>(file.str()), ct::SnapshotError);
+  REQUIRE_THROWS_AS(ct::MappedTreap<int>(file.str() + ".missing"), std::system_error);
+
+  {
+    std::fstream io(file.str(), std::ios::binary | std::ios::in | std::ios::out);
+    io.seekp(static_cast<std::streamoff>(ct::detail::snapshot_header_size));
+    io.put('\x7f');
+  }
+  ct::MappedTreap<int> corrupted(file.str());
+  REQUIRE_FALSE(corrupted.verify());
+}
+
+} // namespace ct_test
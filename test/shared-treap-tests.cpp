@@ -0,0 +1,185 @@
+#include "shared-treap.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace ct_test {
+
+namespace {
+
+class SegmentName {
+public:
+  SegmentName()
+      : name("/ct-shared-" + std::to_string(::getpid()) + "-" + std::to_string(counter++)) {}
+
+  SegmentName(const SegmentName&) = delete;
+  SegmentName& operator=(const SegmentName&) = delete;
+
+  ~SegmentName() {
+    ct::SharedTreap<int>::remove(name);
+  }
+
+  const std::string& str() const {
+    return name;
+  }
+
+private:
+  static inline int counter = 0;
+  std::string name;
+};
+
+template <typename F>
+int run_in_child(F f) {
+  pid_t pid = ::fork();
+  REQUIRE(pid >= 0);
+  if (pid == 0) {
+    ::_exit(f() ? 0 : 1);
+  }
+  int status = 0;
+  ::waitpid(pid, &status, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+} // namespace
+
+TEST_CASE("Shared treap basic operations") {
+  SegmentName name;
+  auto c = ct::SharedTreap<int>::create(name.str(), 64);
+  REQUIRE(c.empty());
+  REQUIRE(c.capacity() == 64);
+
+  for (int i : {5, 1, 9, 3, 7}) {
+    REQUIRE(c.insert(i));
+  }
+  REQUIRE_FALSE(c.insert(3));
+  REQUIRE(c.size() == 5);
+
+  REQUIRE(c.contains(7));
+  REQUIRE_FALSE(c.contains(4));
+  REQUIRE(c.find(4) == std::nullopt);
+  REQUIRE(c.lower_bound(4) == 5);
+  REQUIRE(c.upper_bound(5) == 7);
+  REQUIRE(c.upper_bound(9) == std::nullopt);
+
+  REQUIRE(c.erase(5));
+  REQUIRE_FALSE(c.erase(5));
+
+  std::vector<int> values;
+  c.for_each([&](int value) { values.push_back(value); });
+  REQUIRE(values == std::vector<int>{1, 3, 7, 9});
+
+  c.clear();
+  REQUIRE(c.empty());
+}
+
+TEST_CASE("Shared treap capacity") {
+  SegmentName name;
+  auto c = ct::SharedTreap<int>::create(name.str(), 3);
+  REQUIRE(c.insert(1));
+  REQUIRE(c.insert(2));
+  REQUIRE(c.insert(3));
+  REQUIRE_THROWS_AS(c.insert(4), std::bad_alloc);
+  REQUIRE(c.size() == 3);
+
+  REQUIRE(c.erase(2));
+  REQUIRE(c.insert(4));
+  REQUIRE_FALSE(c.contains(2));
+  REQUIRE(c.contains(4));
+}
+
+TEST_CASE("Shared treap random operations") {
+  SegmentName name;
+  auto c = ct::SharedTreap<int>::create(name.str(), 1'000);
+  std::set<int> expected;
+  std::mt19937 gen(1344);
+  std::uniform_int_distribution<int> dist(0, 999);
+
+  for (int i = 0; i < 20'000; ++i) {
+    int value = dist(gen);
+    if (gen() % 2 == 0) {
+      REQUIRE(c.insert(value) == expected.insert(value).second);
+    } else {
+      REQUIRE(c.erase(value) == (expected.erase(value) == 1));
+    }
+    auto it = expected.lower_bound(value);
+    REQUIRE(c.lower_bound(value) == (it == expected.end() ? std::nullopt : std::optional<int>(*it)));
+  }
+  REQUIRE(c.size() == expected.size());
+}
+
+TEST_CASE("Shared treap across processes") {
+  SegmentName name;
+  auto c = ct::SharedTreap<int>::create(name.str(), 10'000);
+  c.insert(-1);
+
+  int status = run_in_child([&] {
+    auto writer = ct::SharedTreap<int>::open(name.str());
+    for (int i = 0; i < 10'000; i += 2) {
+      writer.insert(i);
+    }
+    return writer.erase(-1);
+  });
+
+  REQUIRE(status == 0);
+  REQUIRE(c.size() == 5'000);
+  REQUIRE_FALSE(c.contains(-1));
+  REQUIRE(c.lower_bound(1) == 2);
+  REQUIRE(c.find(9'998) == 9'998);
+
+  status = run_in_child([&] {
+    auto reader = ct::SharedTreap<int>::open(name.str());
+    return reader.size() == 5'000 && reader.contains(4'000) && !reader.contains(4'001);
+  });
+  REQUIRE(status == 0);
+}
+
+TEST_CASE("Shared treap concurrent reader and writer") {
+  SegmentName name;
+  auto c = ct::SharedTreap<int>::create(name.str(), 20'000);
+
+  pid_t pid = ::fork();
+  REQUIRE(pid >= 0);
+  if (pid == 0) {
+    auto writer = ct::SharedTreap<int>::open(name.str());
+    for (int i = 0; i < 20'000; ++i) {
+      writer.insert(i);
+    }
+    ::_exit(0);
+  }
+
+  bool consistent = true;
+  int status = 0;
+  for (bool running = true; running;) {
+    running = ::waitpid(pid, &status, WNOHANG) == 0;
+    std::size_t seen = c.size();
+    std::optional<int> last;
+    std::size_t count = 0;
+    c.for_each([&](int value) {
+      consistent = consistent && (!last || *last < value);
+      last = value;
+      ++count;
+    });
+    consistent = consistent && count >= seen;
+  }
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(consistent);
+  REQUIRE(c.size() == 20'000);
+}
+
+TEST_CASE("Shared treap rejects mismatched segments") {
+  SegmentName name;
+  auto c = ct::SharedTreap<int>::create(name.str(), 4);
+  REQUIRE_THROWS_AS(ct::SharedTreap<int>::create(name.str(), 4), std::system_error);
+  REQUIRE_THROWS_AS(ct::SharedTreap<long long>::open(name.str()), std::runtime_error);
+  REQUIRE_THROWS_AS(ct::SharedTreap<int>::open(name.str() + "-missing"), std::system_error);
+}
+
+} // namespace ct_test
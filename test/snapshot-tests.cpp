@@ -0,0 +1,168 @@
+#include "treap-map.h"
+#include "treap-multiset.h"
+#include "treap.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace ct_test {
+
+namespace {
+
+struct StringSerializer {
+  static void write(ct::SnapshotWriter& writer, const std::string& value) {
+    writer.write_value<std::uint64_t>(value.size());
+    writer.write(value.data(), value.size());
+  }
+
+  static std::string read(ct::SnapshotReader& reader) {
+    std::string value(reader.read_value<std::uint64_t>(), '\0');
+    reader.read(value.data(), value.size());
+    return value;
+  }
+};
+
+struct EntrySerializer {
+  static void write(ct::SnapshotWriter& writer, const std::pair<const int, std::string>& value) {
+    writer.write_value(value.first);
+    StringSerializer::write(writer, value.second);
+  }
+
+  static std::pair<const int, std::string> read(ct::SnapshotReader& reader) {
+    int key = reader.read_value<int>();
+    return {key, StringSerializer::read(reader)};
+  }
+};
+
+} // namespace
+
+TEST_CASE("Snapshot round trip of trivially copyable elements") {
+  ct::Treap<int> c;
+  std::set<int> expected;
+  // Enough elements to span several copy chunks.
+  for (int i = 0; i < 40'000; ++i) {
+    int value = (i * 7919) % 100'003;
+    c.insert(value);
+    expected.insert(value);
+  }
+
+  std::stringstream stream;
+  c.save(stream);
+
+  ct::Treap<int> loaded;
+  loaded.insert(-1);
+  loaded.load(stream);
+  REQUIRE(loaded.size() == expected.size());
+  REQUIRE(std::equal(loaded.begin(), loaded.end(), expected.begin(), expected.end()));
+
+  loaded.insert(-1);
+  loaded.erase(0);
+  REQUIRE(*loaded.begin() == -1);
+  REQUIRE(loaded.find(0) == loaded.end());
+}
+
+TEST_CASE("Snapshot round trip of empty treap") {
+  ct::Treap<int> c;
+  std::stringstream stream;
+  c.save(stream);
+
+  ct::Treap<int> loaded;
+  loaded.insert(1);
+  loaded.load(stream);
+  REQUIRE(loaded.empty());
+}
+
+TEST_CASE("Snapshot with user serializer") {
+  ct::Treap<std::string> c;
+  c.insert("banana");
+  c.insert("apple");
+  c.insert("");
+
+  std::stringstream stream;
+  c.save<StringSerializer>(stream);
+
+  ct::Treap<std::string> loaded;
+  loaded.load<StringSerializer>(stream);
+  REQUIRE(std::equal(loaded.begin(), loaded.end(), c.begin(), c.end()));
+}
+
+TEST_CASE("Snapshot of multiset and map") {
+  ct::TreapMultiset<int> multiset;
+  multiset.insert(3, 4);
+  multiset.insert(1);
+
+  ct::TreapMap<int, std::string> map;
+  map[2] = "two";
+  map[1] = "one";
+
+  std::stringstream multiset_stream;
+  std::stringstream map_stream;
+  multiset.save(multiset_stream);
+  map.save<EntrySerializer>(map_stream);
+
+  ct::TreapMultiset<int> loaded_multiset;
+  loaded_multiset.load(multiset_stream);
+  REQUIRE(loaded_multiset.size() == 5);
+  REQUIRE(loaded_multiset.distinct_size() == 2);
+  REQUIRE(loaded_multiset.count(3) == 4);
+
+  ct::TreapMap<int, std::string> loaded_map;
+  loaded_map.load<EntrySerializer>(map_stream);
+  REQUIRE(loaded_map.size() == 2);
+  REQUIRE(loaded_map.at(2) == "two");
+}
+
+TEST_CASE("Snapshot rejects corrupted input") {
+  ct::Treap<int> c;
+  for (int i = 0; i < 10; ++i) {
+    c.insert(i);
+  }
+  std::stringstream stream;
+  c.save(stream);
+  std::string bytes = stream.str();
+
+  ct::Treap<int> loaded;
+  loaded.insert(42);
+
+  // The element count is the last field of the header.
+  constexpr std::size_t count_offset = ct::detail::snapshot_header_size - sizeof(std::uint64_t);
+
+  SECTION("flipped payload byte") {
+    bytes[40] ^= 1;
+  }
+  SECTION("truncated") {
+    bytes.resize(bytes.size() - 1);
+  }
+  SECTION("wrong magic") {
+    bytes[0] = 'X';
+  }
+  SECTION("element count larger than memory") {
+    std::uint64_t count = std::numeric_limits<std::uint64_t>::max();
+    std::memcpy(bytes.data() + count_offset, &count, sizeof(count));
+  }
+  SECTION("element count larger than the input") {
+    std::uint64_t count = std::uint64_t{1} << 40;
+    std::memcpy(bytes.data() + count_offset, &count, sizeof(count));
+  }
+  SECTION("wrong element type") {
+    std::stringstream in(bytes);
+    ct::Treap<long long> other;
+    REQUIRE_THROWS_AS(other.load(in), ct::SnapshotError);
+    return;
+  }
+
+  std::stringstream in(bytes);
+  REQUIRE_THROWS_AS(loaded.load(in), ct::SnapshotError);
+  REQUIRE(loaded.size() == 1);
+  REQUIRE(*loaded.begin() == 42);
+}
+
+} // namespace ct_test
@@ -1,3 +1,4 @@
+#include "counted-element.h"
 #include "element.h"
 #include "fault-injection.h"
 #include "test-utils.h"
@@ -6,9 +7,20 @@
 #include <catch2/catch_all.hpp>
 #include <catch2/catch_test_macros.hpp>
 
+#include <algorithm>
+#include <bit>
 #include <iterator>
+#include <numeric>
+#include <optional>
 #include <random>
+#include <set>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace ct_test {
 
@@ -39,6 +51,132 @@ class PerformanceTest : public BaseTest {};
 
 class RandomTest : public BaseTest {};
 
+struct SumAugmentation {
+  using ValueType = long long;
+
+  static ValueType identity() noexcept {
+    return 0;
+  }
+
+  static ValueType lift(int value) noexcept {
+    return value;
+  }
+
+  static ValueType combine(ValueType a, ValueType b) noexcept {
+    return a + b;
+  }
+};
+
+struct SpanAugmentation {
+  struct ValueType {
+    int first = 0;
+    int last = 0;
+    bool empty = true;
+
+    friend bool operator==(const ValueType&, const ValueType&) = default;
+  };
+
+  static ValueType identity() noexcept {
+    return {};
+  }
+
+  static ValueType lift(int value) noexcept {
+    return {value, value, false};
+  }
+
+  static ValueType combine(ValueType a, ValueType b) noexcept {
+    if (a.empty) {
+      return b;
+    }
+    if (b.empty) {
+      return a;
+    }
+    return {a.first, b.last, false};
+  }
+};
+
+// Gives every node the same priority, so nothing is ever rotated and the shape follows the insertion order.
+struct ConstantRng {
+  using result_type = unsigned;
+
+  static constexpr result_type min() noexcept {
+    return 0;
+  }
+
+  static constexpr result_type max() noexcept {
+    return ~0u;
+  }
+
+  result_type operator()() noexcept {
+    return 0;
+  }
+};
+
+// Hands out ever larger priorities, so every new node rotates up above all older ones. Ascending insertions then
+// stay shallow while the older nodes sink into one long path.
+struct IncreasingRng {
+  using result_type = unsigned;
+
+  static constexpr result_type min() noexcept {
+    return 0;
+  }
+
+  static constexpr result_type max() noexcept {
+    return ~0u;
+  }
+
+  result_type operator()() noexcept {
+    return next++;
+  }
+
+  result_type next = 0;
+};
+
+template <
+    typename T,
+    std::uniform_random_bit_generator RandGen = std::mt19937,
+    typename Augmentation = ct::NoAugmentation>
+using Threaded = ct::Treap<T, RandGen, Augmentation, ct::NoInstrumentation, ct::ThreadedLayout>;
+
+template <
+    typename T,
+    std::uniform_random_bit_generator RandGen = std::mt19937,
+    typename Augmentation = ct::NoAugmentation>
+using HotCold = ct::Treap<T, RandGen, Augmentation, ct::NoInstrumentation, ct::HotColdLayout>;
+
+template <typename T, typename Layout = ct::PlainLayout>
+using Filtered =
+    ct::Treap<T, std::mt19937, ct::NoAugmentation, ct::NoInstrumentation, Layout, ct::NoKeyPrefix, ct::BloomFilter>;
+
+template <typename Layout = ct::PlainLayout, size_t Bytes = 8>
+using Prefixed =
+    ct::Treap<std::string, std::mt19937, ct::NoAugmentation, ct::NoInstrumentation, Layout, ct::StringKeyPrefix<Bytes>>;
+
+// Walks `actual` forwards and backwards and compares both walks with `expected`.
+template <typename C>
+void require_sequence(const C& actual, const std::vector<int>& expected) {
+  REQUIRE(actual.size() == expected.size());
+  REQUIRE(std::equal(actual.begin(), actual.end(), expected.begin(), expected.end()));
+  auto it = actual.end();
+  for (auto e = expected.rbegin(); e != expected.rend(); ++e) {
+    REQUIRE(*--it == *e);
+  }
+  REQUIRE(it == actual.begin());
+}
+
+// Loads `0, step, 2 step, ...` from a snapshot. Nothing is searched while loading, so the depth guard does not
+// step in, and with `ConstantRng` the tree becomes a single path.
+template <typename C>
+void load_ascending(C& c, int n, int step = 1) {
+  std::stringstream snapshot;
+  ct::Treap<int> source;
+  for (int i = 0; i < n; ++i) {
+    source.insert(step * i);
+  }
+  source.save(snapshot);
+  c.load(snapshot);
+}
+
 [[maybe_unused]] void magic([[maybe_unused]] Element& c) {
   c = 42;
 }
@@ -173,6 +311,403 @@ TEST_CASE_METHOD(CorrectnessTest, "insert(T&&) doesnt move from source element")
   expect_eq(c, {42});
 }
 
+TEST_CASE_METHOD(CorrectnessTest, "insert(T&&) moves exactly once") {
+  ct::Treap<CountedElement> c;
+  mass_insert_balanced(c, 100);
+
+  CountedElement::reset_counts();
+  CountedElement x(1'000);
+  REQUIRE(c.insert(std::move(x)).second);
+  REQUIRE(CountedElement::moves == 1);
+  REQUIRE(CountedElement::copies == 0);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "emplace()") {
+  ct::Treap<CountedElement> c;
+  mass_insert_balanced(c, 100);
+
+  CountedElement::reset_counts();
+  auto [it, ok] = c.emplace(1'000);
+  REQUIRE(ok);
+  REQUIRE(it->data == 1'000);
+  REQUIRE(CountedElement::moves == 0);
+
+  auto [dup_it, dup_ok] = c.emplace(CountedElement(50));
+  REQUIRE_FALSE(dup_ok);
+  REQUIRE(dup_it->data == 50);
+  REQUIRE(CountedElement::moves == 1);
+  REQUIRE(CountedElement::copies == 0);
+  REQUIRE(c.size() == 101);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "extract()") {
+  Container c;
+  mass_insert(c, {6, 2, 3, 1, 9, 8});
+
+  REQUIRE(c.extract(c.find(6)) == 6);
+  std::optional<Element> e = c.extract(2);
+  REQUIRE(e.has_value());
+  REQUIRE(*e == 2);
+  REQUIRE_FALSE(c.extract(7).has_value());
+  expect_eq(c, {1, 3, 8, 9});
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "pop_front(), pop_back() and extract_front()") {
+  Container c;
+  mass_insert(c, {6, 2, 3, 1, 9, 8});
+
+  c.pop_front();
+  expect_eq(c, {2, 3, 6, 8, 9});
+  c.pop_back();
+  expect_eq(c, {2, 3, 6, 8});
+  REQUIRE(c.extract_front() == 2);
+  expect_eq(c, {3, 6, 8});
+  REQUIRE(*c.begin() == 3);
+  REQUIRE(*c.rbegin() == 8);
+
+  c.pop_back();
+  c.pop_front();
+  c.pop_front();
+  expect_empty(c);
+}
+
+namespace {
+
+// Runs random modifications, copies, moves and snapshots. After each step the contents are compared in both
+// directions, and the cached minimum and maximum behind `begin()` and `rbegin()` are checked on their own.
+template <typename C>
+void check_modifications() {
+  std::mt19937 rng(2'024);
+  std::uniform_int_distribution<int> value_dist(0, 200);
+
+  C c;
+  std::set<int> expected;
+  const auto check = [](const C& actual, const std::set<int>& reference) {
+    require_sequence(actual, std::vector<int>(reference.begin(), reference.end()));
+    if (reference.empty()) {
+      REQUIRE(actual.rbegin() == actual.rend());
+    } else {
+      REQUIRE(*actual.begin() == *reference.begin());
+      REQUIRE(*actual.rbegin() == *reference.rbegin());
+    }
+  };
+
+  for (int i = 0; i < 10'000; ++i) {
+    int e = value_dist(rng);
+    switch (rng() % 8) {
+    case 0:
+    case 1:
+    case 2:
+      REQUIRE(c.insert(e).second == expected.insert(e).second);
+      break;
+    case 3:
+      REQUIRE(c.erase(e) == expected.erase(e));
+      break;
+    case 4: {
+      auto it = c.lower_bound(e);
+      if (it != c.end()) {
+        auto next = c.erase(it);
+        auto expected_next = expected.erase(expected.lower_bound(e));
+        REQUIRE((next == c.end()) == (expected_next == expected.end()));
+      }
+      break;
+    }
+    case 5:
+      if (!expected.empty()) {
+        REQUIRE(c.extract_front() == *expected.begin());
+        expected.erase(expected.begin());
+      }
+      if (!expected.empty()) {
+        c.pop_back();
+        expected.erase(std::prev(expected.end()));
+      }
+      break;
+    case 6: {
+      C copy = c;
+      check(copy, expected);
+      C moved = std::move(copy);
+      check(moved, expected);
+      check(copy, {});
+      swap(c, moved);
+      break;
+    }
+    default:
+      if (rng() % 16 == 0) {
+        std::stringstream snapshot;
+        c.save(snapshot);
+        c.clear();
+        check(c, {});
+        c.load(snapshot);
+      }
+      break;
+    }
+    check(c, expected);
+  }
+  REQUIRE(c.reduce(0, 201) == std::accumulate(expected.begin(), expected.end(), 0LL));
+}
+
+template <typename C>
+void check_layout_rebuilds() {
+  C c;
+  std::vector<int> expected;
+  for (int i = 0; i < 1'000; ++i) {
+    c.insert(i);
+    expected.push_back(i);
+  }
+  REQUIRE(c.rebuilds() > 0);
+  require_sequence(c, expected);
+
+  for (int i = 0; i < 1'000; i += 3) {
+    c.erase(i);
+  }
+  std::erase_if(expected, [](int e) { return e % 3 == 0; });
+  require_sequence(c, expected);
+}
+
+} // namespace
+
+TEST_CASE_METHOD(CorrectnessTest, "Minimum and maximum follow every modification") {
+  check_modifications<ct::Treap<int, std::mt19937, SumAugmentation>>();
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Threaded layout follows every modification") {
+  check_modifications<Threaded<int, std::mt19937, SumAugmentation>>();
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Threaded layout survives depth guard rebuilds") {
+  check_layout_rebuilds<Threaded<int, ConstantRng>>();
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Hot/cold layout follows every modification") {
+  check_modifications<HotCold<int, std::mt19937, SumAugmentation>>();
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Hot/cold layout survives depth guard rebuilds") {
+  check_layout_rebuilds<HotCold<int, ConstantRng>>();
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Hot/cold layout packs the search path densely") {
+  HotCold<int> c;
+  ct::Treap<int> plain;
+  std::mt19937 rng(2'047);
+  for (int i = 0; i < 10'000; ++i) {
+    int e = static_cast<int>(rng());
+    c.insert(e);
+    plain.insert(e);
+  }
+  REQUIRE(std::equal(c.begin(), c.end(), plain.begin(), plain.end()));
+
+  // The stats measure the records a search reads, which are the hot ones.
+  ct::TreapStats stats = c.stats();
+  REQUIRE(stats.nodes_per_cache_line > plain.stats().nodes_per_cache_line);
+  REQUIRE(stats.nodes_per_cache_line > 2);
+  REQUIRE(c.node_size() >= plain.node_size());
+  REQUIRE(c.memory_usage() >= sizeof(c) + c.size() * c.node_size());
+
+  c.clear();
+  REQUIRE(c.memory_usage() == sizeof(c));
+  c.insert(1);
+  REQUIRE(c.find(1) != c.end());
+}
+
+namespace {
+
+// Strings over an alphabet with the smallest and the largest byte, of lengths on both sides of the prefix.
+std::string random_string(std::mt19937& rng) {
+  std::string result(rng() % 20, 'a');
+  for (char& c : result) {
+    c = "\0ab\xff"[rng() % 4];
+  }
+  return result;
+}
+
+template <typename C>
+void check_key_prefixes() {
+  C c;
+  std::set<std::string> expected;
+  std::mt19937 rng(4'049);
+  for (int i = 0; i < 20'000; ++i) {
+    std::string key = random_string(rng);
+    if (rng() % 3 == 0) {
+      REQUIRE(c.erase(key) == expected.erase(key));
+    } else {
+      REQUIRE(c.insert(key).second == expected.insert(key).second);
+    }
+
+    std::string probe = random_string(rng);
+    REQUIRE(c.contains(probe) == expected.contains(probe));
+    auto lower = c.lower_bound(probe);
+    auto expected_lower = expected.lower_bound(probe);
+    REQUIRE(std::distance(c.begin(), lower) == std::distance(expected.begin(), expected_lower));
+    auto upper = c.upper_bound(probe);
+    auto expected_upper = expected.upper_bound(probe);
+    REQUIRE(std::distance(c.begin(), upper) == std::distance(expected.begin(), expected_upper));
+  }
+  REQUIRE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+
+  C copy = c;
+  if constexpr (requires { copy.compact(ct::invalidate_iterators); }) {
+    copy.compact(ct::invalidate_iterators, ct::CompactOrder::van_emde_boas);
+  }
+  for (const std::string& key : expected) {
+    REQUIRE(copy.find(key) != copy.end());
+  }
+  REQUIRE(std::equal(copy.begin(), copy.end(), expected.begin(), expected.end()));
+}
+
+} // namespace
+
+TEST_CASE_METHOD(CorrectnessTest, "Key prefixes keep the order of strings") {
+  check_key_prefixes<Prefixed<>>();
+  check_key_prefixes<Prefixed<ct::ThreadedLayout, 16>>();
+  check_key_prefixes<Prefixed<ct::HotColdLayout>>();
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "StringKeyPrefix orders like std::string") {
+  using Prefix = ct::StringKeyPrefix<8>;
+  // Padding makes a string tie with itself followed by zero bytes, which leaves them to a full comparison.
+  REQUIRE(Prefix::of("") == Prefix::of(std::string(1, '\0')));
+  REQUIRE(Prefix::of("abc") == Prefix::of(std::string("abc\0", 4)));
+  REQUIRE(Prefix::of("abc") < Prefix::of("abd"));
+  REQUIRE(Prefix::of("ab") < Prefix::of("ab\x80"));
+  REQUIRE(Prefix::of("a\xff") < Prefix::of("b"));
+  REQUIRE(Prefix::of("\xff") > Prefix::of("a"));
+  REQUIRE(Prefix::of("abcdefgh") == Prefix::of("abcdefghij"));
+  REQUIRE(ct::StringKeyPrefix<16>::of("abcdefgh") < ct::StringKeyPrefix<16>::of("abcdefghij"));
+}
+
+namespace {
+
+template <typename C>
+void check_bloom_filter() {
+  C c;
+  std::set<int> expected;
+  std::mt19937 rng(5'051);
+  for (int i = 0; i < 100'000; ++i) {
+    int key = static_cast<int>(rng() % 20'000);
+    if (rng() % 3 == 0) {
+      REQUIRE(c.erase(key) == expected.erase(key));
+    } else {
+      REQUIRE(c.insert(key).second == expected.insert(key).second);
+    }
+    int probe = static_cast<int>(rng() % 40'000);
+    REQUIRE(c.contains(probe) == expected.contains(probe));
+  }
+
+  const auto require_all = [&expected](const C& actual) {
+    REQUIRE(actual.size() == expected.size());
+    for (int key : expected) {
+      REQUIRE(actual.find(key) != actual.end());
+    }
+  };
+  C copy = c;
+  require_all(copy);
+  C moved = std::move(copy);
+  require_all(moved);
+  swap(moved, copy);
+  require_all(copy);
+  std::stringstream snapshot;
+  c.save(snapshot);
+  C loaded;
+  loaded.load(snapshot);
+  require_all(loaded);
+
+  // A moved-from or cleared container starts a new filter.
+  for (C* emptied : {&moved, &loaded}) {
+    emptied->clear();
+    REQUIRE(!emptied->contains(1));
+    emptied->insert(1);
+    REQUIRE(emptied->contains(1));
+  }
+}
+
+} // namespace
+
+TEST_CASE_METHOD(CorrectnessTest, "Bloom filter never hides an element") {
+  check_bloom_filter<Filtered<int>>();
+  check_bloom_filter<Filtered<int, ct::HotColdLayout>>();
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Bloom filter options are validated and reported") {
+  Filtered<int> c;
+  REQUIRE(c.stats().filter_memory == 0);
+  REQUIRE_THROWS_AS(c.configure_bloom_filter({.false_positive_rate = 0}), std::invalid_argument);
+  REQUIRE_THROWS_AS(c.configure_bloom_filter({.max_erased_fraction = 1}), std::invalid_argument);
+  REQUIRE(c.bloom_filter().options().false_positive_rate == 0.01);
+
+  for (int i = 0; i < 10'000; ++i) {
+    c.insert(i);
+  }
+  ct::TreapStats stats = c.stats();
+  REQUIRE(stats.filter_memory > 0);
+  REQUIRE(stats.filter_false_positive_rate <= 0.01);
+  REQUIRE(stats.memory_usage == sizeof(c) + c.size() * c.node_size() + stats.filter_memory);
+
+  // A lower rate takes more memory.
+  c.configure_bloom_filter({.false_positive_rate = 0.001});
+  REQUIRE(c.stats().filter_memory > stats.filter_memory);
+  REQUIRE(c.stats().filter_false_positive_rate < stats.filter_false_positive_rate);
+  for (int i = 0; i < 10'000; ++i) {
+    REQUIRE(c.contains(i));
+  }
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Insert, erase and extract never copy") {
+  constexpr int N = 1'000;
+
+  std::mt19937 rng(1'337);
+  std::vector<int> keys(N);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::ranges::shuffle(keys, rng);
+
+  CountedElement::reset_counts();
+  ct::Treap<CountedElement> c;
+  for (int key : keys) {
+    c.insert(CountedElement(key));
+  }
+  for (int i = 0; i < N; i += 4) {
+    c.erase(CountedElement(i));
+    REQUIRE(c.extract(CountedElement(i + 1))->data == i + 1);
+    REQUIRE(c.extract(c.find(CountedElement(i + 2))).data == i + 2);
+  }
+  REQUIRE(c.size() == N / 4);
+  REQUIRE(CountedElement::copies == 0);
+
+  ct::Treap<CountedElement> moved = std::move(c);
+  using std::swap;
+  swap(c, moved);
+  REQUIRE(CountedElement::copies == 0);
+
+  ct::Treap<CountedElement> copy = c;
+  REQUIRE(CountedElement::copies == N / 4);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Move-only elements") {
+  using MoveOnlyContainer = ct::Treap<MoveOnlyElement>;
+  static_assert(!std::is_copy_constructible_v<MoveOnlyContainer>);
+  static_assert(!std::is_copy_assignable_v<MoveOnlyContainer>);
+  static_assert(std::is_nothrow_move_constructible_v<MoveOnlyContainer>);
+
+  MoveOnlyContainer c;
+  for (int i : {5, 3, 8, 1, 4}) {
+    REQUIRE(c.insert(MoveOnlyElement(i)).second);
+  }
+  REQUIRE_FALSE(c.emplace(3).second);
+  REQUIRE(c.emplace(7).second);
+
+  REQUIRE(*c.find(MoveOnlyElement(4))->data == 4);
+  REQUIRE(c.erase(MoveOnlyElement(8)) == 1);
+  MoveOnlyElement smallest = c.extract(c.begin());
+  REQUIRE(*smallest.data == 1);
+
+  MoveOnlyContainer moved = std::move(c);
+  std::vector<int> values;
+  for (const MoveOnlyElement& e : moved) {
+    values.push_back(*e.data);
+  }
+  REQUIRE(values == std::vector<int>{3, 4, 5, 7});
+}
+
 TEST_CASE_METHOD(CorrectnessTest, "Copy constructor from ascending") {
   Container c;
   mass_insert(c, {1, 2, 3, 4});
@@ -886,6 +1421,426 @@ TEST_CASE_METHOD(CorrectnessTest, "Upper bounds") {
   REQUIRE(c.upper_bound(11) == std::next(c.begin(), 7));
 }
 
+TEST_CASE_METHOD(CorrectnessTest, "Reduce over key ranges") {
+  ct::Treap<int, std::mt19937, SumAugmentation> c;
+  for (int i = 1; i <= 10; ++i) {
+    c.insert(i * 10);
+  }
+
+  REQUIRE(c.reduce(0, 1000) == 550);
+  REQUIRE(c.reduce(10, 11) == 10);
+  REQUIRE(c.reduce(10, 10) == 0);
+  REQUIRE(c.reduce(25, 65) == 30 + 40 + 50 + 60);
+  REQUIRE(c.reduce(30, 60) == 30 + 40 + 50);
+  REQUIRE(c.reduce(101, 200) == 0);
+
+  c.erase(40);
+  REQUIRE(c.reduce(25, 65) == 30 + 50 + 60);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Reduce respects element order") {
+  ct::Treap<int, std::mt19937, SpanAugmentation> c;
+  mass_insert(c, {5, 1, 9, 3, 7});
+
+  REQUIRE(c.reduce(0, 100) == SpanAugmentation::ValueType{1, 9, false});
+  REQUIRE(c.reduce(2, 8) == SpanAugmentation::ValueType{3, 7, false});
+  REQUIRE(c.reduce(4, 5) == SpanAugmentation::identity());
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Reduce survives copy and swap") {
+  ct::Treap<int, std::mt19937, SumAugmentation> c1;
+  ct::Treap<int, std::mt19937, SumAugmentation> c2;
+  mass_insert(c1, {1, 2, 3});
+  mass_insert(c2, {10, 20});
+
+  auto c3 = c1;
+  swap(c1, c2);
+  REQUIRE(c1.reduce(0, 100) == 30);
+  REQUIRE(c2.reduce(0, 100) == 6);
+  REQUIRE(c3.reduce(2, 100) == 5);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "for_each() visits a key range in order") {
+  std::mt19937 rng(2'045);
+  ct::Treap<int> c;
+  std::set<int> expected;
+  for (int i = 0; i < 2'000; ++i) {
+    int e = static_cast<int>(rng() % 5'000);
+    c.insert(e);
+    expected.insert(e);
+  }
+
+  const std::vector<std::pair<int, int>> ranges = {
+      {0, 5'000}, {-10, 10}, {1'000, 1'001}, {2'500, 4'000}, {4'990, 6'000}, {7, 7}, {9, 3},
+  };
+  for (auto [lo, hi] : ranges) {
+    std::vector<int> visited;
+    c.for_each(lo, hi, [&visited](int e) { visited.push_back(e); });
+    std::vector<int> reference;
+    std::copy_if(expected.begin(), expected.end(), std::back_inserter(reference), [lo, hi](int e) {
+      return lo <= e && e < hi;
+    });
+    REQUIRE(visited == reference);
+  }
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "scan() hands out full batches in order") {
+  constexpr size_t batch_size = ct::Treap<int>::scan_batch_size;
+
+  Threaded<int> threaded;
+  ct::Treap<int> c;
+  for (int i = 0; i < 1'000; ++i) {
+    c.insert(i);
+    threaded.insert(i);
+  }
+
+  std::vector<size_t> sizes;
+  std::vector<int> visited;
+  c.scan([&](std::span<const int* const> batch) {
+    sizes.push_back(batch.size());
+    for (const int* e : batch) {
+      visited.push_back(*e);
+    }
+  });
+  REQUIRE(std::equal(visited.begin(), visited.end(), c.begin(), c.end()));
+  REQUIRE(sizes.size() == (1'000 + batch_size - 1) / batch_size);
+  REQUIRE(std::all_of(sizes.begin(), std::prev(sizes.end()), [](size_t n) { return n == batch_size; }));
+
+  long long sum = 0;
+  threaded.scan(100, 200, [&sum](std::span<const int* const> batch) {
+    for (const int* e : batch) {
+      sum += *e;
+    }
+  });
+  REQUIRE(sum == (100 + 199) * 100 / 2);
+
+  bool called = false;
+  ct::Treap<int>().scan([&called](auto) { called = true; });
+  c.scan(2'000, 3'000, [&called](auto) { called = true; });
+  REQUIRE_FALSE(called);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Memory usage and stats of empty") {
+  Container c;
+  ct::TreapStats stats = c.stats();
+  REQUIRE(stats.size == 0);
+  REQUIRE(stats.nodes == 0);
+  REQUIRE(stats.height == 0);
+  REQUIRE(stats.depth_histogram.empty());
+  REQUIRE(c.height() == 0);
+  REQUIRE(c.memory_usage() == sizeof(c));
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Memory usage and stats") {
+  ct::Treap<int> c;
+  for (int i = 0; i < 10'000; ++i) {
+    c.insert(i);
+  }
+
+  REQUIRE(c.memory_usage() == sizeof(c) + c.size() * c.node_size());
+
+  ct::TreapStats stats = c.stats();
+  REQUIRE(stats.size == 10'000);
+  REQUIRE(stats.nodes == 10'000);
+  REQUIRE(stats.node_size == c.node_size());
+  REQUIRE(stats.memory_usage == c.memory_usage());
+  REQUIRE(stats.height == c.height());
+  REQUIRE(stats.depth_histogram.size() == stats.height);
+  REQUIRE(stats.depth_histogram[0] == 1);
+
+  size_t total = 0;
+  double path_length = 0;
+  for (size_t depth = 0; depth < stats.depth_histogram.size(); ++depth) {
+    total += stats.depth_histogram[depth];
+    path_length += static_cast<double>(stats.depth_histogram[depth] * (depth + 1));
+  }
+  REQUIRE(total == stats.nodes);
+  REQUIRE(stats.average_path_length == Catch::Approx(path_length / 10'000));
+
+  REQUIRE(stats.expected_path_length == Catch::Approx(16.58).epsilon(0.01));
+  REQUIRE(stats.average_path_length < 2 * stats.expected_path_length);
+  REQUIRE(stats.height < 100);
+
+  REQUIRE(stats.cache_lines > 0);
+  REQUIRE(stats.pages > 0);
+  REQUIRE(stats.pages <= stats.cache_lines);
+  REQUIRE(stats.nodes_per_page >= stats.nodes_per_cache_line);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Stats detect degenerate shape") {
+  ct::Treap<int, ConstantRng> c;
+  load_ascending(c, 100);
+
+  ct::TreapStats stats = c.stats();
+  REQUIRE(c.height() == 100);
+  REQUIRE(stats.depth_histogram == std::vector<size_t>(100, 1));
+  REQUIRE(stats.average_path_length == Catch::Approx(50.5));
+  REQUIRE(stats.average_path_length > 5 * stats.expected_path_length);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Degenerate tree does not exhaust the stack") {
+  // Far deeper than the default stack could hold one frame per level.
+  constexpr int N = 1'000'000;
+
+  ct::Treap<int, ConstantRng> c;
+  load_ascending(c, N, 2);
+  REQUIRE(c.height() == N);
+
+  REQUIRE(c.contains(2 * (N - 1)));
+  REQUIRE(c.lower_bound(2 * N - 3) == std::prev(c.end()));
+  REQUIRE(c.erase(2 * (N / 2)) == 1);
+  REQUIRE(c.extract(std::prev(c.end())) == 2 * (N - 1));
+  REQUIRE(std::distance(c.begin(), c.end()) == N - 2);
+
+  ct::Treap<int, ConstantRng> copy = c;
+  REQUIRE(copy.size() == N - 2);
+  REQUIRE(copy.height() == c.height());
+  REQUIRE(std::equal(c.begin(), c.end(), copy.begin(), copy.end()));
+
+  ct::TreapStats stats = copy.stats();
+  REQUIRE(stats.height == c.height());
+
+  c.clear();
+  expect_empty(c);
+  // `copy` is destroyed as a single path as well.
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Depth guard rebuilds degenerate trees") {
+  constexpr int N = 10'000;
+
+  ct::Treap<int, ConstantRng, SumAugmentation> c;
+  std::vector<ct::Treap<int, ConstantRng, SumAugmentation>::Iterator> its;
+  for (int i = 0; i < N; ++i) {
+    its.push_back(c.insert(i).first);
+  }
+
+  REQUIRE(c.rebuilds() > 0);
+  REQUIRE(c.stats().rebuilds == c.rebuilds());
+  REQUIRE(c.height() <= 4 * static_cast<size_t>(std::bit_width(static_cast<size_t>(N))) + 1);
+
+  // Rebuilding relinks nodes in place, so every iterator still points to its element.
+  for (int i = 0; i < N; ++i) {
+    REQUIRE(*its[static_cast<size_t>(i)] == i);
+    REQUIRE(std::next(its[static_cast<size_t>(i)]) == (i + 1 < N ? its[static_cast<size_t>(i) + 1] : c.end()));
+  }
+  REQUIRE(c.reduce(0, N) == static_cast<long long>(N) * (N - 1) / 2);
+  REQUIRE(c.reduce(100, 200) == 14'950);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Depth guard rebuilds only the bottom of a loaded path") {
+  constexpr int N = 100'000;
+
+  ct::Treap<int, ConstantRng> c;
+  load_ascending(c, N, 2);
+  REQUIRE(c.height() == N);
+  REQUIRE(c.rebuilds() == 0);
+
+  auto last = std::prev(c.end());
+  REQUIRE(c.insert(2 * N).second);
+  REQUIRE(c.rebuilds() == 1);
+  // The lowest ancestor the new node hangs too far below is a few dozen nodes up the path.
+  REQUIRE(c.stats().rebuilt_nodes < 100);
+  REQUIRE(c.height() < N);
+  REQUIRE(*last == 2 * (N - 1));
+  REQUIRE(std::next(last) == std::prev(c.end()));
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Depth guard rebuilds O(log n) nodes per insertion") {
+  constexpr int N = 100'000;
+
+  // Ascending and descending insertions with equal priorities append to one end of the tree every time, which
+  // is the worst case for the guard: each insertion would otherwise add a level.
+  for (bool ascending : {true, false}) {
+    ct::Treap<int, ConstantRng> c;
+    for (int i = 0; i < N; ++i) {
+      c.insert(ascending ? i : -i);
+    }
+    ct::TreapStats stats = c.stats();
+    REQUIRE(stats.rebuilds > 0);
+    REQUIRE(stats.rebuilt_nodes <= N * static_cast<std::size_t>(std::bit_width(static_cast<std::size_t>(N))));
+    // A node may land one level past the guard, which checks the depth of its parent.
+    REQUIRE(c.height() <= 4 * static_cast<std::size_t>(std::bit_width(static_cast<std::size_t>(N))) + 1);
+  }
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Depth guard repairs paths that only lookups walk") {
+  constexpr int N = 200'000;
+  const std::size_t limit = 4 * static_cast<std::size_t>(std::bit_width(static_cast<std::size_t>(N)));
+
+  ct::Treap<int, IncreasingRng> c;
+  for (int i = 0; i < N; ++i) {
+    c.insert(i);
+  }
+  // Every insertion went in next to the root, so the insertion guard never saw the path.
+  REQUIRE(c.height() == N);
+  REQUIRE(c.rebuilds() == 0);
+
+  auto first = c.begin();
+  REQUIRE(c.contains(0));
+  REQUIRE(c.height() == N);
+  REQUIRE(c.erase(N - 1) == 1);
+  REQUIRE(c.rebuilds() == 1);
+  REQUIRE(c.height() <= limit + 1);
+  REQUIRE(first == c.begin());
+  REQUIRE(std::distance(c.begin(), c.end()) == N - 1);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Depth guard keeps lookups short with increasing priorities") {
+  constexpr int N = 200'000;
+  const std::size_t bits = static_cast<std::size_t>(std::bit_width(static_cast<std::size_t>(N)));
+
+  ct::ThreadCountingInstrumentation::reset();
+  ct::Treap<int, IncreasingRng, ct::NoAugmentation, ct::ThreadCountingInstrumentation> c;
+  std::mt19937 rng(2'049);
+  for (int i = 0; i < N; ++i) {
+    c.insert(i);
+    REQUIRE(c.contains(static_cast<int>(rng() % static_cast<unsigned>(i + 1))));
+  }
+
+  ct::TreapCounters finds = ct::ThreadCountingInstrumentation::snapshot()[ct::TreapOperation::find];
+  REQUIRE(finds.calls == N);
+  REQUIRE(finds.node_visits <= 4 * bits * N);
+  REQUIRE(c.stats().rebuilt_nodes <= 2 * bits * N);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "Depth guard leaves random trees alone") {
+  ct::Treap<int> c;
+  mass_insert_balanced(c, 100'000);
+  std::mt19937 rng(7);
+  for (int i = 0; i < 100'000; ++i) {
+    c.insert(static_cast<int>(rng()));
+  }
+  REQUIRE(c.rebuilds() == 0);
+}
+
+namespace {
+
+// Scatters the nodes of `c` through interleaved insertions and erasures, compacts it, and keeps modifying it.
+template <typename C>
+void check_compaction(ct::CompactOrder order) {
+  std::mt19937 rng(2'046);
+  C c;
+  std::set<int> expected;
+  for (int i = 0; i < 20'000; ++i) {
+    int e = static_cast<int>(rng() % 10'000);
+    if (rng() % 3 == 0) {
+      REQUIRE(c.erase(e) == expected.erase(e));
+    } else {
+      REQUIRE(c.insert(e).second == expected.insert(e).second);
+    }
+  }
+  const auto contents = [&expected] { return std::vector<int>(expected.begin(), expected.end()); };
+
+  ct::TreapStats before = c.stats();
+  c.compact(ct::invalidate_iterators, order);
+  ct::TreapStats after = c.stats();
+  require_sequence(c, contents());
+  REQUIRE(after.height == before.height);
+  REQUIRE(after.memory_usage == before.memory_usage);
+  REQUIRE(after.cache_lines <= c.size() * c.node_size() / ct::TreapStats::cache_line_size + 2);
+  REQUIRE(after.pages <= c.size() * c.node_size() / ct::TreapStats::page_size + 2);
+  REQUIRE(after.cache_lines < before.cache_lines);
+  if (order == ct::CompactOrder::in_order) {
+    for (auto it = c.begin(); std::next(it) != c.end(); ++it) {
+      auto gap = reinterpret_cast<const char*>(&*std::next(it)) - reinterpret_cast<const char*>(&*it);
+      REQUIRE(gap == static_cast<std::ptrdiff_t>(c.node_size()));
+    }
+  }
+
+  for (int i = 0; i < 20'000; ++i) {
+    int e = static_cast<int>(rng() % 10'000);
+    if (rng() % 2 == 0) {
+      REQUIRE(c.erase(e) == expected.erase(e));
+    } else {
+      REQUIRE(c.insert(e).second == expected.insert(e).second);
+    }
+    if (i % 5'000 == 0) {
+      c.compact(ct::invalidate_iterators, order);
+    }
+  }
+  require_sequence(c, contents());
+
+  auto copy = c;
+  auto moved = std::move(c);
+  require_sequence(moved, contents());
+  swap(copy, moved);
+  require_sequence(moved, contents());
+  copy.clear();
+  REQUIRE(copy.memory_usage() == sizeof(copy));
+}
+
+} // namespace
+
+TEST_CASE_METHOD(CorrectnessTest, "compact() keeps elements and moves them next to each other") {
+  for (auto order : {ct::CompactOrder::in_order, ct::CompactOrder::van_emde_boas}) {
+    check_compaction<ct::Treap<int>>(order);
+    check_compaction<Threaded<int, std::mt19937, SumAugmentation>>(order);
+  }
+
+  Threaded<int, std::mt19937, SumAugmentation> c;
+  load_ascending(c, 1'000);
+  c.compact(ct::invalidate_iterators, ct::CompactOrder::van_emde_boas);
+  REQUIRE(c.reduce(0, 1'000) == 999 * 1'000 / 2);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "compact() frees a block once all of its elements are gone") {
+  ct::Treap<int> c;
+  mass_insert_balanced(c, 1'000);
+  c.compact(ct::invalidate_iterators);
+  REQUIRE(c.memory_usage() == sizeof(c) + 1'000 * c.node_size());
+
+  for (int i = 1; i <= 500; ++i) {
+    c.erase(i);
+  }
+  c.insert(5'000);
+  REQUIRE(c.memory_usage() == sizeof(c) + 1'001 * c.node_size());
+
+  for (int i = 501; i <= 1'000; ++i) {
+    c.erase(i);
+  }
+  REQUIRE(c.memory_usage() == sizeof(c) + c.node_size());
+  REQUIRE(c.size() == 1);
+}
+
+TEST_CASE_METHOD(CorrectnessTest, "compact_step() compacts in bounded steps") {
+  constexpr size_t step = 64;
+
+  std::mt19937 rng(2'047);
+  ct::Treap<int> c;
+  std::set<int> expected;
+  for (int i = 0; i < 2'000; ++i) {
+    int e = static_cast<int>(rng() % 4'000);
+    c.insert(e);
+    expected.insert(e);
+  }
+
+  size_t steps = 1;
+  while (!c.compact_step(ct::invalidate_iterators, step)) {
+    ++steps;
+    int e = static_cast<int>(rng() % 4'000);
+    REQUIRE(c.erase(e) == expected.erase(e));
+    REQUIRE(c.insert(e + 1).second == expected.insert(e + 1).second);
+    REQUIRE(steps < expected.size());
+  }
+  require_sequence(c, std::vector<int>(expected.begin(), expected.end()));
+
+  steps = 1;
+  while (!c.compact_step(ct::invalidate_iterators, step)) {
+    ++steps;
+  }
+  REQUIRE(steps == (c.size() + step - 1) / step);
+  size_t index = 0;
+  for (auto it = c.begin(); std::next(it) != c.end(); ++it, ++index) {
+    if (index % step != step - 1) {
+      auto gap = reinterpret_cast<const char*>(&*std::next(it)) - reinterpret_cast<const char*>(&*it);
+      REQUIRE(gap == static_cast<std::ptrdiff_t>(c.node_size()));
+    }
+  }
+
+  ct::Treap<int> empty;
+  REQUIRE(empty.compact_step(ct::invalidate_iterators, step));
+}
+
 TEST_CASE_METHOD(ExceptionSafetyTest, "Default constructor does not throw") {
   faulty_run([] {
     try {
@@ -1099,6 +2054,278 @@ TEST_CASE_METHOD(PerformanceTest, "swap(Treap&, Treap&) is fast") {
 
 namespace {
 
+// Counts comparisons, node visits, rotations and allocations on the calling thread, iterator steps included.
+template <typename T>
+using Profiled = ct::Treap<T, std::mt19937, ct::NoAugmentation, ct::ThreadCountingInstrumentation>;
+
+using ProfiledContainer = Profiled<Element>;
+
+constexpr std::mt19937::result_type complexity_seed = 4242;
+
+// The shape of a treap depends only on its keys and priorities, so ascending insertion under a fixed seed builds
+// the same tree everywhere.
+template <typename C>
+void build_ascending(C& c, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    c.insert(static_cast<int>(i));
+  }
+}
+
+ct::TreapCounters profiled(ct::TreapOperation op) {
+  return ct::ThreadCountingInstrumentation::snapshot()[op];
+}
+
+// Average comparisons of a `find` over `k` hits and `k` misses spread over a tree of `n` elements.
+template <typename T>
+double average_find_comparisons(size_t n, size_t k, size_t& max_comparisons) {
+  Profiled<T> c{std::mt19937(complexity_seed)};
+  build_ascending(c, n);
+
+  ct::ThreadCountingInstrumentation::reset();
+  size_t element_comparisons = Element::comparisons();
+  max_comparisons = 0;
+  for (size_t i = 0; i < k; ++i) {
+    int key = static_cast<int>(i * 7'919 % n);
+    for (int probe : {key, -key - 1}) {
+      size_t before = profiled(ct::TreapOperation::find).comparisons;
+      REQUIRE((c.find(probe) != c.end()) == (probe >= 0));
+      max_comparisons = std::max(max_comparisons, profiled(ct::TreapOperation::find).comparisons - before);
+    }
+  }
+  if constexpr (std::is_same_v<T, Element>) {
+    // The engine counts exactly the comparisons `Element` sees.
+    REQUIRE(Element::comparisons() - element_comparisons == profiled(ct::TreapOperation::find).comparisons);
+  }
+  return static_cast<double>(profiled(ct::TreapOperation::find).comparisons) / static_cast<double>(2 * k);
+}
+
+} // namespace
+
+TEST_CASE_METHOD(PerformanceTest, "find(const T&) performs O(log n) comparisons") {
+  constexpr size_t K = 5'000;
+
+  size_t small_max = 0;
+  size_t large_max = 0;
+  double small = average_find_comparisons<Element>(10'000, K, small_max);
+  // Comparisons of `int` are counted the same way, and a million `Element`s would take long to check.
+  double large = average_find_comparisons<int>(1'000'000, K, large_max);
+
+  // log2(1e6) is about 20; a random treap averages about 1.39 log2(n) comparisons per search.
+  REQUIRE(large <= 2 * 20);
+  REQUIRE(large_max <= 4 * 20);
+  // A hundred times more elements cost at most twice as many comparisons, not a hundred times as many.
+  REQUIRE(large <= 2 * small);
+  REQUIRE(small_max < large_max);
+}
+
+TEST_CASE_METHOD(PerformanceTest, "insert() compares once per level when keys have operator<=>") {
+  constexpr size_t N = 10'000;
+
+  Profiled<std::string> strings{std::mt19937(complexity_seed)};
+  ProfiledContainer elements{std::mt19937(complexity_seed)};
+  std::mt19937 rng(complexity_seed);
+  ct::ThreadCountingInstrumentation::reset();
+  for (size_t i = 0; i < N; ++i) {
+    strings.insert(std::to_string(rng() % N));
+  }
+  ct::TreapCounters inserts = profiled(ct::TreapOperation::insert);
+  REQUIRE(inserts.comparisons == inserts.node_visits);
+
+  // `Element` has only the two-way operators, so telling a match apart takes a second call.
+  ct::ThreadCountingInstrumentation::reset();
+  size_t element_comparisons = Element::comparisons();
+  for (size_t i = 0; i < N; ++i) {
+    elements.insert(static_cast<int>(rng() % N));
+  }
+  inserts = profiled(ct::TreapOperation::insert);
+  REQUIRE(Element::comparisons() - element_comparisons == inserts.comparisons);
+  REQUIRE(inserts.comparisons > inserts.node_visits);
+  REQUIRE(inserts.comparisons < 2 * inserts.node_visits);
+}
+
+TEST_CASE_METHOD(PerformanceTest, "Bloom filter turns away most misses") {
+  constexpr size_t N = 100'000;
+
+  using Container = ct::Treap<
+      int,
+      std::mt19937,
+      ct::NoAugmentation,
+      ct::ThreadCountingInstrumentation,
+      ct::PlainLayout,
+      ct::NoKeyPrefix,
+      ct::BloomFilter>;
+  Container c{std::mt19937(complexity_seed)};
+  for (size_t i = 0; i < N; ++i) {
+    c.insert(static_cast<int>(2 * i));
+  }
+
+  const auto passed_misses = [&c] {
+    size_t passed = 0;
+    for (size_t i = 0; i < N; ++i) {
+      size_t before = profiled(ct::TreapOperation::find).node_visits;
+      REQUIRE(!c.contains(static_cast<int>(2 * i + 1)));
+      passed += profiled(ct::TreapOperation::find).node_visits != before ? 1 : 0;
+    }
+    return static_cast<double>(passed) / static_cast<double>(N);
+  };
+  // Blocking costs some accuracy against the estimate, which assumes the bits of all keys spread evenly.
+  REQUIRE(passed_misses() < 2 * std::max(c.stats().filter_false_positive_rate, 0.001));
+  REQUIRE(c.stats().filter_false_positive_rate < 0.01);
+
+  // Erased keys pass until the filter is rebuilt, which happens once they are a quarter of the elements.
+  for (size_t i = 0; i < N / 5; ++i) {
+    c.erase(static_cast<int>(2 * i));
+  }
+  size_t before = profiled(ct::TreapOperation::find).node_visits;
+  for (size_t i = 0; i < N / 5; ++i) {
+    REQUIRE(!c.contains(static_cast<int>(2 * i)));
+  }
+  REQUIRE(profiled(ct::TreapOperation::find).node_visits - before > N / 5);
+  for (size_t i = N / 5; i < N / 2; ++i) {
+    c.erase(static_cast<int>(2 * i));
+  }
+  REQUIRE(passed_misses() < 0.02);
+}
+
+TEST_CASE_METHOD(PerformanceTest, "Key prefixes leave only ties to full comparisons") {
+  constexpr size_t N = 100'000;
+
+  using Container = ct::Treap<
+      std::string,
+      std::mt19937,
+      ct::NoAugmentation,
+      ct::ThreadCountingInstrumentation,
+      ct::PlainLayout,
+      ct::StringKeyPrefix<>>;
+  Container c{std::mt19937(complexity_seed)};
+  // Eight digits make every prefix unique.
+  const auto key = [](size_t i) { return std::to_string(10'000'000 + 2 * i) + "/suffix"; };
+  for (size_t i = 0; i < N; ++i) {
+    c.insert(key(i));
+  }
+
+  ct::ThreadCountingInstrumentation::reset();
+  for (size_t i = 0; i < N; ++i) {
+    REQUIRE(c.contains(key(i)));
+    REQUIRE(!c.contains(std::to_string(10'000'000 + 2 * i + 1)));
+  }
+  // A hit meets its own key once in the descent and once more to confirm the match; a miss never ties.
+  ct::TreapCounters finds = profiled(ct::TreapOperation::find);
+  REQUIRE(finds.comparisons == 2 * N);
+  REQUIRE(finds.node_visits > 10 * finds.comparisons);
+}
+
+TEST_CASE_METHOD(PerformanceTest, "pop_front() performs no rotations") {
+  constexpr size_t N = 100'000;
+
+  Profiled<int> c{std::mt19937(complexity_seed)};
+  std::mt19937 rng(complexity_seed);
+  for (size_t i = 0; i < N; ++i) {
+    c.insert(static_cast<int>(rng()));
+  }
+
+  ct::ThreadCountingInstrumentation::reset();
+  int previous = *c.begin();
+  while (!c.empty()) {
+    REQUIRE(*c.begin() >= previous);
+    previous = *c.begin();
+    c.pop_front();
+  }
+  ct::TreapCounters erases = profiled(ct::TreapOperation::erase);
+  REQUIRE(erases.calls == N);
+  REQUIRE(erases.rotations == 0);
+  REQUIRE(erases.comparisons == 0);
+}
+
+TEST_CASE_METHOD(PerformanceTest, "size() performs no comparisons") {
+  constexpr size_t N = 10'000;
+
+  ProfiledContainer c{std::mt19937(complexity_seed)};
+  build_ascending(c, N);
+
+  ct::ThreadCountingInstrumentation::reset();
+  size_t element_comparisons = Element::comparisons();
+  for (size_t i = 0; i < N; ++i) {
+    REQUIRE(c.size() == N);
+  }
+  REQUIRE(Element::comparisons() == element_comparisons);
+  REQUIRE(ct::ThreadCountingInstrumentation::snapshot().total() == ct::TreapCounters{});
+}
+
+TEST_CASE_METHOD(PerformanceTest, "Building from a sorted range performs O(n) allocations") {
+  constexpr size_t N = 100'000;
+
+  ct::ThreadCountingInstrumentation::reset();
+  ProfiledContainer c{std::mt19937(complexity_seed)};
+  build_ascending(c, N);
+
+  ct::TreapCounters inserts = profiled(ct::TreapOperation::insert);
+  REQUIRE(inserts.calls == N);
+  REQUIRE(inserts.allocations == N);
+  REQUIRE(inserts.deallocations == 0);
+  // Each insertion rotates fewer than two times on average.
+  REQUIRE(inserts.rotations <= 2 * N);
+
+  ct::ThreadCountingInstrumentation::reset();
+  ProfiledContainer copy = c;
+  REQUIRE(profiled(ct::TreapOperation::other).allocations == N);
+  REQUIRE(profiled(ct::TreapOperation::other).comparisons == 0);
+}
+
+TEST_CASE_METHOD(PerformanceTest, "Iteration touches O(n) nodes") {
+  constexpr size_t N = 100'000;
+
+  ProfiledContainer c{std::mt19937(complexity_seed)};
+  build_ascending(c, N);
+
+  ct::ThreadCountingInstrumentation::reset();
+  size_t element_comparisons = Element::comparisons();
+  size_t forward = 0;
+  for (auto it = c.begin(); it != c.end(); ++it) {
+    ++forward;
+  }
+  REQUIRE(forward == N);
+  // Every edge is walked at most once down and once up, plus the step from the root to `end()`.
+  REQUIRE(profiled(ct::TreapOperation::other).node_visits <= 2 * N);
+
+  ct::ThreadCountingInstrumentation::reset();
+  size_t backward = 0;
+  for (auto it = c.rbegin(); it != c.rend(); ++it) {
+    ++backward;
+  }
+  REQUIRE(backward == N);
+  REQUIRE(profiled(ct::TreapOperation::other).node_visits <= 2 * N);
+  REQUIRE(profiled(ct::TreapOperation::other).comparisons == 0);
+  REQUIRE(Element::comparisons() == element_comparisons);
+}
+
+TEST_CASE_METHOD(PerformanceTest, "Threaded iterators visit one node per step") {
+  constexpr size_t N = 100'000;
+
+  ct::Treap<int, std::mt19937, ct::NoAugmentation, ct::ThreadCountingInstrumentation, ct::ThreadedLayout> c{
+      std::mt19937(complexity_seed)
+  };
+  build_ascending(c, N);
+
+  ct::ThreadCountingInstrumentation::reset();
+  size_t forward = 0;
+  for (auto it = c.begin(); it != c.end(); ++it) {
+    ++forward;
+  }
+  REQUIRE(forward == N);
+  REQUIRE(profiled(ct::TreapOperation::other).node_visits == N);
+
+  ct::ThreadCountingInstrumentation::reset();
+  size_t backward = 0;
+  for (auto it = c.end(); it != c.begin(); --it) {
+    ++backward;
+  }
+  REQUIRE(backward == N);
+  REQUIRE(profiled(ct::TreapOperation::other).node_visits == N);
+}
+
+namespace {
+
 struct RandomTestConfig {
   std::mt19937::result_type seed = std::mt19937::default_seed;
   std::uniform_int_distribution<int> value_dist;
@@ -1144,8 +2371,37 @@ void run_random_test(RandomTestConfig cfg) {
   }
 }
 
+void run_random_reduce_test(std::mt19937::result_type seed, size_t iterations) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> value_dist(1, 1'000);
+
+  std::set<int> std_set;
+  ct::Treap<int, std::mt19937, SumAugmentation> treap;
+
+  for (size_t i = 0; i < iterations; ++i) {
+    int e = value_dist(rng);
+    if (rng() % 3 == 0) {
+      REQUIRE(treap.erase(e) == std_set.erase(e));
+    } else {
+      REQUIRE(treap.insert(e).second == std_set.insert(e).second);
+    }
+
+    int lo = value_dist(rng);
+    int hi = value_dist(rng);
+    long long expected = 0;
+    for (auto it = std_set.lower_bound(lo); it != std_set.end() && *it < hi; ++it) {
+      expected += *it;
+    }
+    REQUIRE(treap.reduce(lo, hi) == expected);
+  }
+}
+
 } // namespace
 
+TEST_CASE_METHOD(RandomTest, "Random reduces") {
+  run_random_reduce_test(1343, 10'000);
+}
+
 TEST_CASE_METHOD(RandomTest, "Random insertions (scattered)") {
   RandomTestConfig cfg;
   cfg.seed = 1337;
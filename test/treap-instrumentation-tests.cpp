@@ -0,0 +1,126 @@
+#include "treap-instrumentation.h"
+#include "treap.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <random>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+
+namespace ct_test {
+
+namespace {
+
+using CountingTreap = ct::Treap<int, std::mt19937, ct::NoAugmentation, ct::CountingInstrumentation>;
+using ThreadCountingTreap = ct::Treap<int, std::mt19937, ct::NoAugmentation, ct::ThreadCountingInstrumentation>;
+
+} // namespace
+
+static_assert(std::is_empty_v<ct::NoInstrumentation>);
+
+TEST_CASE("Instrumentation counts allocations and rotations of inserts") {
+  CountingTreap c;
+  for (int i = 0; i < 1'000; ++i) {
+    c.insert(i);
+  }
+  c.insert(500);
+
+  const ct::TreapCounters& inserts = c.instrumentation().snapshot()[ct::TreapOperation::insert];
+  REQUIRE(inserts.calls == 1'001);
+  REQUIRE(inserts.allocations == 1'000);
+  REQUIRE(inserts.deallocations == 0);
+  REQUIRE(inserts.rotations > 0);
+  REQUIRE(inserts.node_visits > 1'000);
+  REQUIRE(inserts.comparisons >= inserts.node_visits);
+
+  REQUIRE(c.instrumentation().snapshot()[ct::TreapOperation::find] == ct::TreapCounters{});
+}
+
+TEST_CASE("Instrumentation attributes events to operations") {
+  CountingTreap c;
+  for (int i = 0; i < 100; ++i) {
+    c.insert(i * 2);
+  }
+  c.instrumentation().reset();
+  REQUIRE(c.instrumentation().snapshot().total() == ct::TreapCounters{});
+
+  REQUIRE(c.find(42) != c.end());
+  REQUIRE(c.find(43) == c.end());
+  REQUIRE(c.contains(44));
+  REQUIRE(*c.lower_bound(45) == 46);
+  REQUIRE(c.erase(46) == 1);
+  c.erase(c.begin());
+
+  const ct::TreapProfile& profile = c.instrumentation().snapshot();
+  REQUIRE(profile[ct::TreapOperation::find].calls == 3);
+  REQUIRE(profile[ct::TreapOperation::find].node_visits <= 3 * c.height());
+  REQUIRE(profile[ct::TreapOperation::find].allocations == 0);
+  REQUIRE(profile[ct::TreapOperation::lower_bound].calls == 1);
+  REQUIRE(
+      profile[ct::TreapOperation::lower_bound].comparisons == profile[ct::TreapOperation::lower_bound].node_visits
+  );
+  REQUIRE(profile[ct::TreapOperation::erase].calls == 2);
+  REQUIRE(profile[ct::TreapOperation::erase].deallocations == 2);
+  REQUIRE(profile[ct::TreapOperation::insert].calls == 0);
+
+  c.clear();
+  REQUIRE(c.instrumentation().snapshot()[ct::TreapOperation::clear].deallocations == 98);
+}
+
+TEST_CASE("Instrumentation counts the nodes a snapshot load replaces") {
+  CountingTreap source;
+  for (int i = 0; i < 100; ++i) {
+    source.insert(i);
+  }
+  std::stringstream snapshot;
+  source.save(snapshot);
+
+  CountingTreap c;
+  for (int i = 0; i < 10; ++i) {
+    c.insert(-i);
+  }
+  c.instrumentation().reset();
+  c.load(snapshot);
+
+  const ct::TreapCounters& loading = c.instrumentation().snapshot()[ct::TreapOperation::other];
+  REQUIRE(loading.allocations == 100);
+  REQUIRE(loading.deallocations == 10);
+  REQUIRE(c.instrumentation().snapshot().total().allocations == 100);
+}
+
+TEST_CASE("Instrumentation counters belong to the instance") {
+  CountingTreap c1;
+  c1.insert(1);
+  c1.insert(2);
+
+  CountingTreap c2 = c1;
+  REQUIRE(c2.instrumentation().snapshot()[ct::TreapOperation::other].allocations == 2);
+  REQUIRE(c2.instrumentation().snapshot()[ct::TreapOperation::insert].calls == 0);
+  REQUIRE(c1.instrumentation().snapshot()[ct::TreapOperation::insert].calls == 2);
+}
+
+TEST_CASE("Per-thread instrumentation") {
+  ct::ThreadCountingInstrumentation::reset();
+  ThreadCountingTreap c1;
+  ThreadCountingTreap c2;
+  c1.insert(1);
+  c2.insert(2);
+
+  ct::TreapCounters other_thread;
+  std::thread other([&other_thread] {
+    ThreadCountingTreap c;
+    c.insert(3);
+    c.insert(4);
+    other_thread = ct::ThreadCountingInstrumentation::snapshot()[ct::TreapOperation::insert];
+  });
+  other.join();
+
+  REQUIRE(other_thread.calls == 2);
+  REQUIRE(ct::ThreadCountingInstrumentation::snapshot()[ct::TreapOperation::insert].calls == 2);
+  REQUIRE(ct::ThreadCountingInstrumentation::snapshot()[ct::TreapOperation::insert].allocations == 2);
+  ct::ThreadCountingInstrumentation::reset();
+  REQUIRE(ct::ThreadCountingInstrumentation::snapshot().total() == ct::TreapCounters{});
+}
+
+} // namespace ct_test
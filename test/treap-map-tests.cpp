@@ -0,0 +1,94 @@
+#include "treap-map.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace ct_test {
+
+TEST_CASE("Map subscript and lookup") {
+  ct::TreapMap<std::string, int> c;
+  c["b"] = 2;
+  c["a"] = 1;
+  ++c["b"];
+
+  REQUIRE(c.size() == 2);
+  REQUIRE(c.at("a") == 1);
+  REQUIRE(c.at("b") == 3);
+  REQUIRE_THROWS_AS(c.at("c"), std::out_of_range);
+  REQUIRE(c.find("c") == c.end());
+  REQUIRE(c.begin()->first == "a");
+
+  c.begin()->second = 10;
+  REQUIRE(std::as_const(c).find("a")->second == 10);
+}
+
+TEST_CASE("Map try_emplace does not construct for existing keys") {
+  ct::TreapMap<int, std::unique_ptr<int>> c;
+  auto [it, inserted] = c.try_emplace(1, std::make_unique<int>(42));
+  REQUIRE(inserted);
+  REQUIRE(*it->second == 42);
+
+  auto value = std::make_unique<int>(7);
+  auto [it2, inserted2] = c.try_emplace(1, std::move(value));
+  REQUIRE_FALSE(inserted2);
+  REQUIRE(it2 == it);
+  REQUIRE(value != nullptr);
+}
+
+TEST_CASE("Map insert_or_assign") {
+  ct::TreapMap<int, std::string> c;
+  REQUIRE(c.insert_or_assign(1, "one").second);
+  REQUIRE_FALSE(c.insert_or_assign(1, "uno").second);
+  REQUIRE(c.at(1) == "uno");
+
+  REQUIRE_FALSE(c.insert({1, "ein"}).second);
+  REQUIRE(c.at(1) == "uno");
+  REQUIRE(c.erase(1) == 1);
+  REQUIRE(c.empty());
+}
+
+TEST_CASE("Map iterators convert to const iterators") {
+  ct::TreapMap<int, int> c;
+  c[1] = 1;
+  c[2] = 2;
+
+  ct::TreapMap<int, int>::ConstIterator it = c.begin();
+  REQUIRE(it == c.begin());
+  REQUIRE(c.erase(it) == c.find(2));
+}
+
+TEST_CASE("Random map operations") {
+  std::mt19937 rng(1347);
+  std::uniform_int_distribution<int> key_dist(1, 500);
+
+  std::map<int, int> expected;
+  ct::TreapMap<int, int> c;
+
+  for (size_t i = 0; i < 20'000; ++i) {
+    int key = key_dist(rng);
+    int value = static_cast<int>(rng() % 1'000);
+    switch (rng() % 4) {
+    case 0:
+      REQUIRE(c.erase(key) == expected.erase(key));
+      break;
+    case 1:
+      REQUIRE(c.insert_or_assign(key, value).second == expected.insert_or_assign(key, value).second);
+      break;
+    default:
+      c[key] += value;
+      expected[key] += value;
+      break;
+    }
+    REQUIRE(c.size() == expected.size());
+  }
+  REQUIRE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+}
+
+} // namespace ct_test
@@ -0,0 +1,105 @@
+#include "treap-multiset.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <random>
+
+namespace ct_test {
+
+TEST_CASE("Multiset counts duplicates in one node") {
+  ct::TreapMultiset<int> c;
+  c.insert(5);
+  c.insert(3);
+  c.insert(5);
+  c.insert(5, 3);
+
+  REQUIRE(c.size() == 6);
+  REQUIRE(c.distinct_size() == 2);
+  REQUIRE(c.count(5) == 5);
+  REQUIRE(c.count(3) == 1);
+  REQUIRE(c.count(4) == 0);
+  REQUIRE(c.count(c.find(5)) == 5);
+  REQUIRE(*c.begin() == 3);
+  REQUIRE(*std::next(c.begin()) == 5);
+}
+
+TEST_CASE("Multiset erase") {
+  ct::TreapMultiset<int> c;
+  c.insert(1, 2);
+  c.insert(2, 4);
+  c.insert(3);
+
+  REQUIRE(c.erase(2, 3) == 3);
+  REQUIRE(c.count(2) == 1);
+  REQUIRE(c.size() == 4);
+
+  REQUIRE(c.erase(1) == 2);
+  REQUIRE(c.erase(1) == 0);
+  REQUIRE(c.size() == 2);
+
+  auto it = c.erase(c.find(2));
+  REQUIRE(*it == 3);
+  REQUIRE(c.size() == 1);
+  REQUIRE(c.distinct_size() == 1);
+
+  ct::TreapMultiset<int> copy = c;
+  c.clear();
+  REQUIRE(c.empty());
+  REQUIRE(c.distinct_size() == 0);
+  REQUIRE(copy.count(3) == 1);
+}
+
+TEST_CASE("Multiset erase by iterator removes one occurrence") {
+  ct::TreapMultiset<int> c;
+  c.insert(1);
+  c.insert(2, 3);
+  c.insert(3);
+  REQUIRE(std::distance(c.begin(), c.end()) == static_cast<std::ptrdiff_t>(c.distinct_size()));
+
+  auto it = c.erase(c.find(2));
+  REQUIRE(*it == 2);
+  REQUIRE(c.count(2) == 2);
+  REQUIRE(c.size() == 4);
+  REQUIRE(c.distinct_size() == 3);
+
+  it = c.erase(c.erase(it));
+  REQUIRE(*it == 3);
+  REQUIRE(c.count(2) == 0);
+  REQUIRE(c.size() == 2);
+  REQUIRE(c.distinct_size() == 2);
+}
+
+TEST_CASE("Random multiset operations") {
+  std::mt19937 rng(1346);
+  std::uniform_int_distribution<int> value_dist(1, 200);
+
+  std::map<int, std::size_t> expected;
+  std::size_t expected_size = 0;
+  ct::TreapMultiset<int> c;
+
+  for (size_t i = 0; i < 20'000; ++i) {
+    int e = value_dist(rng);
+    if (rng() % 3 != 0) {
+      c.insert(e);
+      ++expected[e];
+      ++expected_size;
+    } else {
+      std::size_t n = rng() % 3;
+      std::size_t removed = std::min(n, expected[e]);
+      REQUIRE(c.erase(e, n) == removed);
+      expected_size -= removed;
+      if ((expected[e] -= removed) == 0) {
+        expected.erase(e);
+      }
+    }
+
+    REQUIRE(c.size() == expected_size);
+    REQUIRE(c.distinct_size() == expected.size());
+    REQUIRE(c.count(e) == (expected.contains(e) ? expected[e] : 0));
+  }
+}
+
+} // namespace ct_test
@@ -0,0 +1,111 @@
+#include "treap-trace.h"
+#include "treap.h"
+
+#include <catch2/catch_all.hpp>
+
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ct_test {
+
+TEST_CASE("Trace round trip") {
+  std::stringstream trace;
+  {
+    ct::TraceWriter<std::int64_t> writer(trace);
+    writer.write(ct::TraceOp::insert, 5);
+    writer.write(ct::TraceOp::erase, -7);
+    writer.write(ct::TraceOp::find, 1LL << 40);
+    writer.write(ct::TraceOp::lower_bound, 0);
+  }
+  REQUIRE(trace.str().size() == 16 + 4 * (1 + sizeof(std::int64_t)));
+
+  ct::TraceReader<std::int64_t> reader(trace);
+  std::vector<std::pair<ct::TraceOp, std::int64_t>> records;
+  while (auto record = reader.next()) {
+    records.emplace_back(record->op, record->key);
+  }
+  REQUIRE(
+      records == std::vector<std::pair<ct::TraceOp, std::int64_t>>{
+                     {ct::TraceOp::insert, 5},
+                     {ct::TraceOp::erase, -7},
+                     {ct::TraceOp::find, 1LL << 40},
+                     {ct::TraceOp::lower_bound, 0},
+                 }
+  );
+}
+
+TEST_CASE("Trace recorder forwards and records") {
+  ct::Treap<int> c;
+  std::stringstream trace;
+  ct::TraceRecorder recorder(c, trace);
+
+  std::mt19937 gen(1348);
+  std::uniform_int_distribution<int> dist(0, 100);
+  std::vector<ct::TraceOp> ops;
+  for (int i = 0; i < 1'000; ++i) {
+    int key = dist(gen);
+    switch (gen() % 4) {
+    case 0:
+      recorder.insert(key);
+      ops.push_back(ct::TraceOp::insert);
+      break;
+    case 1:
+      recorder.erase(key);
+      ops.push_back(ct::TraceOp::erase);
+      break;
+    case 2:
+      REQUIRE((recorder.find(key) == c.end()) == !c.contains(key));
+      ops.push_back(ct::TraceOp::find);
+      break;
+    default:
+      REQUIRE(recorder.lower_bound(key) == c.lower_bound(key));
+      ops.push_back(ct::TraceOp::lower_bound);
+      break;
+    }
+  }
+  REQUIRE(&recorder.get() == &c);
+
+  // Replaying the trace into a fresh container reproduces the same contents.
+  ct::Treap<int> replayed;
+  ct::TraceReader<int> reader(trace);
+  std::size_t count = 0;
+  while (auto record = reader.next()) {
+    REQUIRE(record->op == ops[count++]);
+    if (record->op == ct::TraceOp::insert) {
+      replayed.insert(record->key);
+    } else if (record->op == ct::TraceOp::erase) {
+      replayed.erase(record->key);
+    }
+  }
+  REQUIRE(count == ops.size());
+  REQUIRE(std::equal(replayed.begin(), replayed.end(), c.begin(), c.end()));
+}
+
+TEST_CASE("Trace reader rejects malformed input") {
+  std::stringstream garbage("not a trace at all");
+  REQUIRE_THROWS_AS(ct::TraceReader<int>(garbage), ct::TraceError);
+
+  std::stringstream trace;
+  {
+    ct::TraceWriter<int> writer(trace);
+    writer.write(ct::TraceOp::insert, 1);
+  }
+  std::string bytes = trace.str();
+
+  std::stringstream wrong_key(bytes);
+  REQUIRE_THROWS_AS(ct::TraceReader<std::int64_t>(wrong_key), ct::TraceError);
+
+  std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+  ct::TraceReader<int> truncated_reader(truncated);
+  REQUIRE_THROWS_AS(truncated_reader.next(), ct::TraceError);
+
+  bytes[16] = '\x7f';
+  std::stringstream bad_op(bytes);
+  ct::TraceReader<int> bad_op_reader(bad_op);
+  REQUIRE_THROWS_AS(bad_op_reader.next(), ct::TraceError);
+}
+
+} // namespace ct_test
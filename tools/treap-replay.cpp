@@ -0,0 +1,198 @@
+// Replays a trace recorded with `ct::TraceRecorder` against `ct::Treap` and `std::set`.
+//
+//   treap-replay <trace> [--check]
+//
+// For each container it reports throughput, per-operation latency percentiles taken from a `ct::LatencyHistogram`,
+// and the final size and heap usage. With `CT_BENCH_PERF` set it also reports cache, TLB and branch misses per
+// operation of the throughput pass, or `n/a` where the hardware counters are unavailable.
+// `--check` first replays the trace against both containers side by side and stops at the first operation whose
+// results differ.
+
+#include "bench-utils.h"
+#include "latency-histogram.h"
+#include "perf-counters.h"
+#include "treap-trace.h"
+#include "treap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <set>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename K>
+std::vector<ct::TraceRecord<K>> read_trace(std::istream& in) {
+  ct::TraceReader<K> reader(in);
+  std::vector<ct::TraceRecord<K>> result;
+  while (auto record = reader.next()) {
+    result.push_back(*record);
+  }
+  return result;
+}
+
+// Performs one traced operation; the result only keeps the work from being optimized out.
+template <typename C, typename K>
+std::size_t apply(C& c, const ct::TraceRecord<K>& record) {
+  switch (record.op) {
+  case ct::TraceOp::insert:
+    return c.insert(record.key).second;
+  case ct::TraceOp::erase:
+    return c.erase(record.key);
+  case ct::TraceOp::find:
+    return c.find(record.key) != c.end();
+  case ct::TraceOp::lower_bound:
+    return c.lower_bound(record.key) != c.end();
+  }
+  return 0;
+}
+
+template <typename K>
+bool check(const std::vector<ct::TraceRecord<K>>& trace) {
+  ct::Treap<K> treap;
+  std::set<K> std_set;
+
+  for (std::size_t i = 0; i < trace.size(); ++i) {
+    const auto& [op, key] = trace[i];
+    bool same = true;
+    switch (op) {
+    case ct::TraceOp::insert: {
+      auto [treap_it, treap_ins] = treap.insert(key);
+      auto [std_it, std_ins] = std_set.insert(key);
+      same = treap_ins == std_ins && *treap_it == *std_it;
+      break;
+    }
+    case ct::TraceOp::erase:
+      same = treap.erase(key) == std_set.erase(key);
+      break;
+    case ct::TraceOp::find:
+      same = (treap.find(key) == treap.end()) == (std_set.find(key) == std_set.end());
+      break;
+    case ct::TraceOp::lower_bound: {
+      auto treap_it = treap.lower_bound(key);
+      auto std_it = std_set.lower_bound(key);
+      bool std_end = std_it == std_set.end();
+      same = (treap_it == treap.end()) == std_end && (std_end || *treap_it == *std_it);
+      break;
+    }
+    }
+    same = same && treap.size() == std_set.size();
+    if (!same) {
+      std::printf("check: results differ at record %zu\n", i);
+      return false;
+    }
+  }
+  if (!std::equal(treap.begin(), treap.end(), std_set.begin(), std_set.end())) {
+    std::printf("check: final contents differ\n");
+    return false;
+  }
+  std::printf("check: %zu operations match std::set\n", trace.size());
+  return true;
+}
+
+template <typename C, typename K>
+void replay(std::string_view name, const std::vector<ct::TraceRecord<K>>& trace) {
+  std::size_t checksum = 0;
+
+  std::size_t bytes_before = ct_bench::allocated_bytes();
+  C c;
+  std::optional<ct_bench::PerfCounters> counters;
+  if (ct_bench::PerfCounters::requested()) {
+    counters.emplace();
+    counters->start();
+  }
+  auto start = Clock::now();
+  for (const auto& record : trace) {
+    checksum += apply(c, record);
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  ct_bench::PerfCounts counts;
+  if (counters) {
+    counts = counters->stop();
+  }
+  std::size_t heap_bytes = ct_bench::allocated_bytes() - bytes_before;
+
+  ct::LatencyHistogram latencies;
+  C timed;
+  for (const auto& record : trace) {
+    std::uint64_t op_start = ct::SteadyClockSource::now();
+    checksum += apply(timed, record);
+    latencies.record(ct::SteadyClockSource::now() - op_start);
+  }
+
+  std::printf(
+      "%-10.*s %12.0f ops/s  p50 %6llu ns  p99 %6llu ns  p99.9 %6llu ns  max %8llu ns  size %zu  heap %zu bytes"
+      "  (checksum %zu)\n",
+      static_cast<int>(name.size()), name.data(), static_cast<double>(trace.size()) / elapsed.count(),
+      static_cast<unsigned long long>(latencies.percentile(0.5)),
+      static_cast<unsigned long long>(latencies.percentile(0.99)),
+      static_cast<unsigned long long>(latencies.percentile(0.999)), static_cast<unsigned long long>(latencies.max()),
+      c.size(), heap_bytes, checksum
+  );
+  if (counters) {
+    std::printf("%-10s", "");
+    for (std::size_t i = 0; i < ct_bench::perf_event_count; ++i) {
+      std::string_view event = ct_bench::to_string(static_cast<ct_bench::PerfEvent>(i));
+      if (counts[i]) {
+        double per_op = static_cast<double>(*counts[i]) / static_cast<double>(std::max<std::size_t>(trace.size(), 1));
+        std::printf(" %.*s/op %.3f", static_cast<int>(event.size()), event.data(), per_op);
+      } else {
+        std::printf(" %.*s/op n/a", static_cast<int>(event.size()), event.data());
+      }
+    }
+    std::printf("\n");
+  }
+}
+
+template <typename K>
+int run(std::istream& in, bool correctness) {
+  std::vector<ct::TraceRecord<K>> trace = read_trace<K>(in);
+  std::printf("%zu operations on %zu-byte keys\n", trace.size(), sizeof(K));
+  if (correctness && !check(trace)) {
+    return 1;
+  }
+  replay<ct::Treap<K>>("ct::Treap", trace);
+  replay<std::set<K>>("std::set", trace);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3 || (argc == 3 && std::strcmp(argv[2], "--check") != 0)) {
+    std::fprintf(stderr, "usage: %s <trace> [--check]\n", argv[0]);
+    return 2;
+  }
+  bool correctness = argc == 3;
+
+  try {
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+      std::fprintf(stderr, "cannot open %s\n", argv[1]);
+      return 2;
+    }
+    std::uint32_t key_size = ct::read_trace_header(in);
+    in.seekg(0);
+    switch (key_size) {
+    case sizeof(std::int32_t):
+      return run<std::int32_t>(in, correctness);
+    case sizeof(std::int64_t):
+      return run<std::int64_t>(in, correctness);
+    default:
+      std::fprintf(stderr, "unsupported key size %u\n", key_size);
+      return 2;
+    }
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 2;
+  }
+}